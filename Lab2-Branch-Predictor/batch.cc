@@ -0,0 +1,376 @@
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include "utils.h"
+#include "harness.h"
+
+/////////////////////////////////////////////////////////////
+// Batch mode: many traces on a pool of worker processes
+/////////////////////////////////////////////////////////////
+
+/*
+	Each trace runs in its own forked worker, which gets a private copy of
+	the predictor instances and needs no locking. A worker runs one trace and
+	sends its TRACE_RESULT back over a pipe; at most `jobs` workers are alive
+	at a time. Traces are started largest file first so the whole batch
+	finishes in roughly the time of the longest trace.
+*/
+
+class BATCH_JOB{
+  public:
+  pid_t  pid;
+  int    fd;      // read end of the worker's result pipe
+  int    trace;   // index into the trace list
+};
+
+static double Now(){
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bool WriteAll(int fd, const void *buf, size_t len){
+  const char *p = (const char *)buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool ReadAll(int fd, void *buf, size_t len){
+  char *p = (char *)buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////
+
+// A directory contributes every regular file in it (sorted by name, like
+// the shell glob run.csh used); anything else is read as a list of trace
+// paths, one per line
+static bool ReadTraceList(char *listName, vector<string> *traces){
+  struct stat st;
+
+  if (stat(listName, &st) != 0) return false;
+
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(listName);
+    struct dirent *ent;
+    if (dir == NULL) return false;
+    while ((ent = readdir(dir)) != NULL) {
+      string path = string(listName) + "/" + ent->d_name;
+      if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        traces->push_back(path);
+      }
+    }
+    closedir(dir);
+    sort(traces->begin(), traces->end());
+  } else {
+    FILE *list = fopen(listName, "r");
+    char line[4096];
+    if (list == NULL) return false;
+    while (fgets(line, sizeof(line), list) != NULL) {
+      size_t len = strcspn(line, "\r\n");
+      line[len] = '\0';
+      if (len > 0 && line[0] != '#') traces->push_back(line);
+    }
+    fclose(list);
+  }
+
+  return true;
+}
+
+static off_t FileSize(const string &path){
+  struct stat st;
+  return (stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+/////////////////////////////////////////////////////////////
+
+// A counter vector goes over the pipe as its length and its elements
+static bool WriteCounts(int fd, const vector<UINT64> &v){
+  UINT64 count = v.size();
+  return WriteAll(fd, &count, sizeof(count)) &&
+         (count == 0 || WriteAll(fd, &v[0], count * sizeof(UINT64)));
+}
+
+static bool ReadCounts(int fd, vector<UINT64> *v, int expected){
+  UINT64 count;
+  if (!ReadAll(fd, &count, sizeof(count)) || count != (UINT64)expected) return false;
+  v->resize(count);
+  return count == 0 || ReadAll(fd, &(*v)[0], count * sizeof(UINT64));
+}
+
+static void RunWorker(char *traceName, bool threaded, int fd){
+  TRACE_RESULT result;
+
+  RunTrace(traceName, threaded, false, &result);
+
+  if (!WriteAll(fd, &result.numInst, sizeof(result.numInst)) ||
+      !WriteAll(fd, &result.numCondBranch, sizeof(result.numCondBranch)) ||
+      !WriteAll(fd, &result.wallSecs, sizeof(result.wallSecs)) ||
+      !WriteCounts(fd, result.numMispred) ||
+      !WriteCounts(fd, result.numTargetLookups) ||
+      !WriteCounts(fd, result.numTargetMispred)) {
+    _exit(1);
+  }
+  _exit(0);
+}
+
+static bool ReadResult(int fd, TRACE_RESULT *result){
+  return ReadAll(fd, &result->numInst, sizeof(result->numInst)) &&
+         ReadAll(fd, &result->numCondBranch, sizeof(result->numCondBranch)) &&
+         ReadAll(fd, &result->wallSecs, sizeof(result->wallSecs)) &&
+         ReadCounts(fd, &result->numMispred, NumPredictors()) &&
+         ReadCounts(fd, &result->numTargetLookups, NumTargetPredictors()) &&
+         ReadCounts(fd, &result->numTargetMispred, NumTargetPredictors());
+}
+
+/////////////////////////////////////////////////////////////
+
+static double Mpki(UINT64 numMispred, UINT64 numInst){
+  return numInst ? 1000.0 * (double)numMispred / (double)numInst : 0.0;
+}
+
+static void PrintJsonString(FILE *out, const string &s){
+  fputc('"', out);
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '"' || s[i] == '\\') fputc('\\', out);
+    fputc(s[i], out);
+  }
+  fputc('"', out);
+}
+
+static void WriteCsv(FILE *out, const vector<string> &traces, const vector<TRACE_RESULT> &results,
+                     const vector<double> &avgMpki, const vector<double> &avgTargetMpki,
+                     double wallSecs, UINT64 totalInst){
+  int p, numPred = NumPredictors(), numTarget = NumTargetPredictors();
+
+  fprintf(out, "trace,status,num_instructions,num_conditional_br");
+  for (p = 0; p < numPred; p++) {
+    fprintf(out, ",%s_mispredictions,%s_mpki", PredictorName(p), PredictorName(p));
+  }
+  for (p = 0; p < numTarget; p++) {
+    fprintf(out, ",%s_target_mispredictions,%s_target_mpki", TargetPredictorName(p), TargetPredictorName(p));
+  }
+  fprintf(out, ",wall_seconds,records_per_sec\n");
+
+  for (size_t t = 0; t < traces.size(); t++) {
+    const TRACE_RESULT &r = results[t];
+    if (!r.ok) {
+      fprintf(out, "%s,failed,,", traces[t].c_str());
+      for (p = 0; p < numPred + numTarget; p++) fprintf(out, ",,");
+      fprintf(out, ",,\n");
+      continue;
+    }
+    fprintf(out, "%s,ok,%llu,%llu", traces[t].c_str(), r.numInst, r.numCondBranch);
+    for (p = 0; p < numPred; p++) {
+      fprintf(out, ",%llu,%.3f", r.numMispred[p], Mpki(r.numMispred[p], r.numInst));
+    }
+    for (p = 0; p < numTarget; p++) {
+      fprintf(out, ",%llu,%.3f", r.numTargetMispred[p], Mpki(r.numTargetMispred[p], r.numInst));
+    }
+    fprintf(out, ",%.3f,%.0f\n", r.wallSecs, r.wallSecs > 0 ? r.numInst / r.wallSecs : 0.0);
+  }
+
+  fprintf(out, "AVERAGE,,%llu,", totalInst);
+  for (p = 0; p < numPred; p++) {
+    fprintf(out, ",,%.3f", avgMpki[p]);
+  }
+  for (p = 0; p < numTarget; p++) {
+    fprintf(out, ",,%.3f", avgTargetMpki[p]);
+  }
+  fprintf(out, ",%.3f,%.0f\n", wallSecs, wallSecs > 0 ? totalInst / wallSecs : 0.0);
+}
+
+static void WriteJson(FILE *out, const vector<string> &traces, const vector<TRACE_RESULT> &results,
+                      const vector<double> &avgMpki, const vector<double> &avgTargetMpki,
+                      double wallSecs, UINT64 totalInst){
+  int p, numPred = NumPredictors(), numTarget = NumTargetPredictors();
+
+  fprintf(out, "{\n  \"predictors\": [");
+  for (p = 0; p < numPred; p++) {
+    fprintf(out, "%s\"%s\"", p ? ", " : "", PredictorName(p));
+  }
+  if (numTarget > 0) {
+    fprintf(out, "],\n  \"target_predictors\": [");
+    for (p = 0; p < numTarget; p++) {
+      fprintf(out, "%s\"%s\"", p ? ", " : "", TargetPredictorName(p));
+    }
+  }
+  fprintf(out, "],\n  \"traces\": [");
+
+  for (size_t t = 0; t < traces.size(); t++) {
+    const TRACE_RESULT &r = results[t];
+    fprintf(out, "%s\n    {\"trace\": ", t ? "," : "");
+    PrintJsonString(out, traces[t]);
+    if (!r.ok) {
+      fprintf(out, ", \"status\": \"failed\"}");
+      continue;
+    }
+    fprintf(out, ", \"status\": \"ok\", \"num_instructions\": %llu, \"num_conditional_br\": %llu",
+            r.numInst, r.numCondBranch);
+    fprintf(out, ", \"mispredictions\": {");
+    for (p = 0; p < numPred; p++) {
+      fprintf(out, "%s\"%s\": %llu", p ? ", " : "", PredictorName(p), r.numMispred[p]);
+    }
+    fprintf(out, "}, \"mpki\": {");
+    for (p = 0; p < numPred; p++) {
+      fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", PredictorName(p), Mpki(r.numMispred[p], r.numInst));
+    }
+    if (numTarget > 0) {
+      fprintf(out, "}, \"target_mispredictions\": {");
+      for (p = 0; p < numTarget; p++) {
+        fprintf(out, "%s\"%s\": %llu", p ? ", " : "", TargetPredictorName(p), r.numTargetMispred[p]);
+      }
+      fprintf(out, "}, \"target_mpki\": {");
+      for (p = 0; p < numTarget; p++) {
+        fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", TargetPredictorName(p),
+                Mpki(r.numTargetMispred[p], r.numInst));
+      }
+    }
+    fprintf(out, "}, \"wall_seconds\": %.3f, \"records_per_sec\": %.0f}",
+            r.wallSecs, r.wallSecs > 0 ? r.numInst / r.wallSecs : 0.0);
+  }
+
+  fprintf(out, "\n  ],\n  \"average_mpki\": {");
+  for (p = 0; p < numPred; p++) {
+    fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", PredictorName(p), avgMpki[p]);
+  }
+  if (numTarget > 0) {
+    fprintf(out, "},\n  \"average_target_mpki\": {");
+    for (p = 0; p < numTarget; p++) {
+      fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", TargetPredictorName(p), avgTargetMpki[p]);
+    }
+  }
+  fprintf(out, "},\n  \"num_instructions\": %llu,\n  \"wall_seconds\": %.3f,\n  \"records_per_sec\": %.0f\n}\n",
+          totalInst, wallSecs, wallSecs > 0 ? totalInst / wallSecs : 0.0);
+}
+
+/////////////////////////////////////////////////////////////
+
+int RunBatchMode(char *listName, int jobs, bool threaded, bool json, char *outName){
+  vector<string> traces;
+  vector<int> order;
+  vector<BATCH_JOB> running;
+  size_t next = 0, done = 0;
+  int p, numPred = NumPredictors(), numTarget = NumTargetPredictors(), numFailed = 0;
+
+  if (!ReadTraceList(listName, &traces) || traces.empty()) {
+    printf("No traces found in %s. Dying\n", listName);
+    exit(-1);
+  }
+
+  vector<TRACE_RESULT> results(traces.size());
+  vector<off_t> sizes(traces.size());
+  for (size_t t = 0; t < traces.size(); t++) {
+    order.push_back(t);
+    sizes[t] = FileSize(traces[t]);
+  }
+  stable_sort(order.begin(), order.end(),
+              [&sizes](int a, int b) { return sizes[a] > sizes[b]; });
+
+  double start = Now();
+  fflush(stdout);
+
+  while (next < order.size() || !running.empty()) {
+
+    // Keep the pool full
+    while ((int)running.size() < jobs && next < order.size()) {
+      BATCH_JOB job;
+      int fds[2];
+      if (pipe(fds) != 0) {
+        printf("Unable to create a pipe. Dying\n");
+        exit(-1);
+      }
+      job.trace = order[next++];
+      job.fd = fds[0];
+      job.pid = fork();
+      if (job.pid < 0) {
+        printf("Unable to fork a worker. Dying\n");
+        exit(-1);
+      }
+      if (job.pid == 0) {
+        // Keep worker messages out of a summary written to stdout
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        close(fds[0]);
+        RunWorker((char *)traces[job.trace].c_str(), threaded, fds[1]);
+      }
+      close(fds[1]);
+      running.push_back(job);
+    }
+
+    // Collect whichever worker finishes first
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) break;
+
+    for (size_t j = 0; j < running.size(); j++) {
+      if (running[j].pid != pid) continue;
+
+      TRACE_RESULT &r = results[running[j].trace];
+      r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && ReadResult(running[j].fd, &r);
+      // A file that decodes to no instructions is not a trace; it must not
+      // enter the averages as 0 MPKI
+      if (r.ok && r.numInst == 0) r.ok = false;
+      close(running[j].fd);
+      if (!r.ok) numFailed++;
+
+      fprintf(stderr, "[%zu/%zu] %s %s (%.1f s)\n", ++done, traces.size(),
+              traces[running[j].trace].c_str(), r.ok ? "done" : "FAILED", r.wallSecs);
+      running.erase(running.begin() + j);
+      break;
+    }
+  }
+
+  double wallSecs = Now() - start;
+
+  // Average MPKI over the traces that completed, as run.csh reported it
+  vector<double> avgMpki(numPred, 0.0), avgTargetMpki(numTarget, 0.0);
+  UINT64 totalInst = 0;
+  int numOk = 0;
+  for (size_t t = 0; t < traces.size(); t++) {
+    if (!results[t].ok) continue;
+    numOk++;
+    totalInst += results[t].numInst;
+    for (p = 0; p < numPred; p++) {
+      avgMpki[p] += Mpki(results[t].numMispred[p], results[t].numInst);
+    }
+    for (p = 0; p < numTarget; p++) {
+      avgTargetMpki[p] += Mpki(results[t].numTargetMispred[p], results[t].numInst);
+    }
+  }
+  for (p = 0; p < numPred; p++) {
+    if (numOk) avgMpki[p] /= numOk;
+  }
+  for (p = 0; p < numTarget; p++) {
+    if (numOk) avgTargetMpki[p] /= numOk;
+  }
+
+  FILE *out = stdout;
+  if (outName != NULL && strcmp(outName, "-") != 0) {
+    if ((out = fopen(outName, "w")) == NULL) {
+      printf("Unable to open %s. Dying\n", outName);
+      exit(-1);
+    }
+  }
+
+  if (json) WriteJson(out, traces, results, avgMpki, avgTargetMpki, wallSecs, totalInst);
+  else      WriteCsv(out, traces, results, avgMpki, avgTargetMpki, wallSecs, totalInst);
+
+  if (out != stdout) fclose(out);
+
+  return numFailed ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#ifndef _BATCHRING_H_
+#define _BATCHRING_H_
+
+#include <atomic>
+#include <thread>
+#include "utils.h"
+#include "tracer.h"
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Single-producer/multi-consumer ring of record batches. The producer
+// fills a slot and publishes it by advancing head; every consumer walks
+// all published slots with its own tail, and a slot is reused only once
+// the slowest consumer has released it. No locks are taken: each side
+// spins (yielding) on the other's counter.
+
+#define BATCH_RING_SLOTS         64
+#define BATCH_RING_MAX_CONSUMERS 64
+
+class BATCH_RING{
+ private:
+  CBP_TRACE_RECORD *slots[BATCH_RING_SLOTS];
+  UINT32 sizes[BATCH_RING_SLOTS];
+  int    numConsumers;
+
+  std::atomic<UINT64> head;                            // slots published
+  std::atomic<UINT64> tail[BATCH_RING_MAX_CONSUMERS];  // slots released
+  std::atomic<bool>   done;
+
+  UINT64 MinTail(){
+    UINT64 min = tail[0].load(std::memory_order_acquire);
+    for (int i = 1; i < numConsumers; i++){
+      UINT64 t = tail[i].load(std::memory_order_acquire);
+      if (t < min) min = t;
+    }
+    return min;
+  }
+
+ public:
+  BATCH_RING(int consumers){
+    numConsumers = consumers;
+    for (int i = 0; i < BATCH_RING_SLOTS; i++){
+      slots[i] = new CBP_TRACE_RECORD[CBP_TRACE_BATCH_SIZE];
+      sizes[i] = 0;
+    }
+    head.store(0);
+    for (int i = 0; i < BATCH_RING_MAX_CONSUMERS; i++){
+      tail[i].store(0);
+    }
+    done.store(false);
+  }
+
+  ~BATCH_RING(){
+    for (int i = 0; i < BATCH_RING_SLOTS; i++){
+      delete [] slots[i];
+    }
+  }
+
+  // Producer: wait for a free slot and return it for filling
+  CBP_TRACE_RECORD *Acquire(){
+    UINT64 h = head.load(std::memory_order_relaxed);
+    while (h - MinTail() >= BATCH_RING_SLOTS){
+      std::this_thread::yield();
+    }
+    return slots[h % BATCH_RING_SLOTS];
+  }
+
+  // Producer: make the slot returned by Acquire visible to consumers
+  void Publish(UINT32 size){
+    UINT64 h = head.load(std::memory_order_relaxed);
+    sizes[h % BATCH_RING_SLOTS] = size;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  // Producer: no more batches will be published
+  void Finish(){
+    done.store(true, std::memory_order_release);
+  }
+
+  // Consumer: wait for the next batch; NULL once the ring is drained
+  const CBP_TRACE_RECORD *Next(int consumer, UINT32 *size){
+    UINT64 t = tail[consumer].load(std::memory_order_relaxed);
+    while (t == head.load(std::memory_order_acquire)){
+      if (done.load(std::memory_order_acquire) &&
+          (t == head.load(std::memory_order_acquire))){
+        return NULL;
+      }
+      std::this_thread::yield();
+    }
+    *size = sizes[t % BATCH_RING_SLOTS];
+    return slots[t % BATCH_RING_SLOTS];
+  }
+
+  // Consumer: done with the batch returned by Next
+  void Release(int consumer){
+    tail[consumer].fetch_add(1, std::memory_order_release);
+  }
+};
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+#endif // _BATCHRING_H_
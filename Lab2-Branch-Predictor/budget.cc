@@ -0,0 +1,133 @@
+#include <math.h>
+#include "budget.h"
+
+/////////////////////////////////////////////////////////////
+// Storage budget of a predictor configuration
+/////////////////////////////////////////////////////////////
+
+void STORAGE_BUDGET::Table(const string &name, UINT64 entries, UINT32 bits, int stage){
+  STORAGE_TABLE t;
+  t.name = name;
+  t.entries = entries;
+  t.bits = bits;
+  t.stage = stage;
+  tables.push_back(t);
+}
+
+UINT64 STORAGE_BUDGET::TotalBits() const {
+  UINT64 total = 0;
+  for (size_t i = 0; i < tables.size(); i++) {
+    total += tables[i].entries * tables[i].bits;
+  }
+  return total;
+}
+
+/////////////////////////////////////////////////////////////
+// First-order SRAM access model
+/////////////////////////////////////////////////////////////
+
+// Round numbers of the order CACTI reports for small itrs-hp arrays at
+// 32 nm (the technology in the lab's .cfg files); about 0.3 ns and
+// 2 pJ for a 4 KB table
+#define SRAM_MAT_ROWS      256
+#define SRAM_MAT_COLS      256
+#define SRAM_DECODE_NS     0.010     // per row address bit
+#define SRAM_WORDLINE_NS   0.0004    // per column of a mat
+#define SRAM_BITLINE_NS    0.0004    // per row of a mat
+#define SRAM_SENSE_NS      0.040
+#define SRAM_MUX_NS        0.005     // per level of column multiplexing
+#define SRAM_ROUTE_NS      0.030     // per mat along the side of the array
+#define SRAM_CELL_PJ       0.00005   // per cell on an active bitline
+#define SRAM_SENSE_PJ      0.002     // per active column
+#define SRAM_ROUTE_PJ      0.010     // per output bit per mat crossed
+#define SRAM_CELL_UM2      0.15
+#define SRAM_PERIPHERY     1.6       // decoders, sense amps and wiring over the cells
+#define FLOP_UM2           1.5       // per register bit
+
+static double CeilDiv(UINT64 a, UINT64 b){
+  return (double)((a + b - 1) / b);
+}
+
+ACCESS_ESTIMATE EstimateTable(const STORAGE_TABLE &table){
+  ACCESS_ESTIMATE e;
+  UINT64 bits = table.entries * table.bits;
+
+  e.latencyNs = 0;
+  e.readEnergyPj = 0;
+  if (table.entries <= 1 || bits == 0) {
+    e.areaMm2 = bits * FLOP_UM2 / 1e6;
+    return e;
+  }
+
+  // Put w entries in a row until the array is about as wide as it is tall
+  UINT64 w = 1;
+  while (2 * w <= table.entries && table.entries / (2 * w) >= table.bits * 2 * w) w *= 2;
+  UINT64 rows = (table.entries + w - 1) / w;
+  UINT64 cols = table.bits * w;
+
+  double matRows = CeilDiv(rows, SRAM_MAT_ROWS);
+  double matCols = CeilDiv(cols, SRAM_MAT_COLS);
+  double r = ceil(rows / matRows);
+  double c = ceil(cols / matCols);
+  double mats = matRows * matCols;
+
+  e.latencyNs = SRAM_DECODE_NS * BitsFor((UINT64)r) + SRAM_WORDLINE_NS * c + SRAM_BITLINE_NS * r
+              + SRAM_SENSE_NS + SRAM_MUX_NS * BitsFor(w) + SRAM_ROUTE_NS * sqrt(mats);
+  e.readEnergyPj = matCols * (SRAM_CELL_PJ * r * c + SRAM_SENSE_PJ * c)
+                 + SRAM_ROUTE_PJ * table.bits * sqrt(mats);
+  e.areaMm2 = bits * SRAM_CELL_UM2 * SRAM_PERIPHERY / 1e6;
+  return e;
+}
+
+ACCESS_ESTIMATE EstimateAccess(const STORAGE_BUDGET &budget){
+  ACCESS_ESTIMATE total;
+  int maxStage = STORAGE_NO_STAGE;
+
+  total.latencyNs = 0;
+  total.readEnergyPj = 0;
+  total.areaMm2 = 0;
+  for (size_t i = 0; i < budget.tables.size(); i++) {
+    if (budget.tables[i].stage > maxStage) maxStage = budget.tables[i].stage;
+    total.areaMm2 += EstimateTable(budget.tables[i]).areaMm2;
+  }
+
+  for (int stage = 0; stage <= maxStage; stage++) {
+    double slowest = 0;
+    for (size_t i = 0; i < budget.tables.size(); i++) {
+      if (budget.tables[i].stage != stage) continue;
+      ACCESS_ESTIMATE e = EstimateTable(budget.tables[i]);
+      if (e.latencyNs > slowest) slowest = e.latencyNs;
+      total.readEnergyPj += e.readEnergyPj;
+    }
+    total.latencyNs += slowest;
+  }
+  return total;
+}
+
+int AccessCycles(const ACCESS_ESTIMATE &access, double clockGHz){
+  int cycles = (int)ceil(access.latencyNs * clockGHz - 1e-9);
+  return cycles > 0 ? cycles : 1;
+}
+
+void PrintBudget(FILE *out, const char *name, const STORAGE_BUDGET &budget, double clockGHz){
+  ACCESS_ESTIMATE access = EstimateAccess(budget);
+  UINT64 total = budget.TotalBits();
+
+  fprintf(out, "\nBUDGET %s: %llu bits (%.2f Kbit)\n", name, total, total / 1024.0);
+  fprintf(out, "  %-24s  %10s  %5s  %5s  %10s  %8s  %8s\n",
+          "table", "entries", "bits", "stage", "total bits", "ns", "pJ");
+  for (size_t i = 0; i < budget.tables.size(); i++) {
+    const STORAGE_TABLE &t = budget.tables[i];
+    ACCESS_ESTIMATE e = EstimateTable(t);
+    if (t.stage == STORAGE_NO_STAGE) {
+      fprintf(out, "  %-24s  %10llu  %5u  %5s  %10llu  %8s  %8s\n",
+              t.name.c_str(), t.entries, t.bits, "-", t.entries * t.bits, "-", "-");
+    } else {
+      fprintf(out, "  %-24s  %10llu  %5u  %5d  %10llu  %8.3f  %8.3f\n",
+              t.name.c_str(), t.entries, t.bits, t.stage, t.entries * t.bits, e.latencyNs, e.readEnergyPj);
+    }
+  }
+  fprintf(out, "  access: %.3f ns = %d cycle%s at %.2f GHz, %.2f pJ per prediction, %.4f mm2\n",
+          access.latencyNs, AccessCycles(access, clockGHz), AccessCycles(access, clockGHz) == 1 ? "" : "s",
+          clockGHz, access.readEnergyPj, access.areaMm2);
+}
@@ -0,0 +1,84 @@
+#ifndef _BUDGET_H_
+#define _BUDGET_H_
+
+#include <vector>
+#include "utils.h"
+
+/////////////////////////////////////////////////////////////
+// Storage budget of a predictor configuration
+/////////////////////////////////////////////////////////////
+
+/*
+	A predictor lists its state in Storage as tables of entries x bits,
+	counting the bits hardware would keep rather than the simulator's C
+	types: a 2-bit counter held in an int is 2 bits. Histories, pointers
+	and global counters are registers (one-entry tables).
+
+	stage orders the reads of one prediction: tables of the same stage
+	are read in parallel and the stages one after another (a PAp reads
+	its history register, then the counter it selects). Tables that are
+	only written, or are held in flip-flops, have no stage.
+*/
+
+#define STORAGE_NO_STAGE  -1
+
+class STORAGE_TABLE{
+  public:
+  string name;
+  UINT64 entries;
+  UINT32 bits;       // per entry
+  int    stage;
+};
+
+class STORAGE_BUDGET{
+ public:
+  vector<STORAGE_TABLE> tables;
+
+  void Table(const string &name, UINT64 entries, UINT32 bits, int stage);
+  void Register(const string &name, UINT32 bits){ Table(name, 1, bits, STORAGE_NO_STAGE); }
+
+  UINT64 TotalBits() const;
+};
+
+// Bits to hold the values 0 .. n-1
+static inline UINT32 BitsFor(UINT64 n){
+  UINT32 bits = 0;
+  while ((1ULL << bits) < n) bits++;
+  return bits;
+}
+
+/////////////////////////////////////////////////////////////
+// First-order SRAM access model
+/////////////////////////////////////////////////////////////
+
+/*
+	An analytic stand-in for a CACTI run, for ranking configurations and
+	filtering sweeps, not for sign-off: each table is a single-ported
+	SRAM at 32 nm folded into near-square mats of at most 256 x 256 cells,
+	and latency is decoder + wordline + bitline + sense amplifier + mat
+	routing. Energy is one read of every staged table. Registers cost
+	area and no latency. Hashing, tag compares and adder trees are not
+	modeled.
+*/
+
+class ACCESS_ESTIMATE{
+  public:
+  double latencyNs;
+  double readEnergyPj;
+  double areaMm2;
+};
+
+ACCESS_ESTIMATE EstimateTable(const STORAGE_TABLE &table);
+
+// Latency is the sum over stages of each stage's slowest table
+ACCESS_ESTIMATE EstimateAccess(const STORAGE_BUDGET &budget);
+
+// Whole clock cycles the access takes at clockGHz
+int AccessCycles(const ACCESS_ESTIMATE &access, double clockGHz);
+
+// Per-table breakdown, totals and the access estimate
+void PrintBudget(FILE *out, const char *name, const STORAGE_BUDGET &budget, double clockGHz);
+
+/////////////////////////////////////////////////////////////
+
+#endif // _BUDGET_H_
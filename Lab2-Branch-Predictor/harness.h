@@ -0,0 +1,52 @@
+#ifndef _HARNESS_H_
+#define _HARNESS_H_
+
+#include <vector>
+#include "utils.h"
+
+/////////////////////////////////////////////////////////////
+// Results of running every predictor over one trace
+/////////////////////////////////////////////////////////////
+
+class TRACE_RESULT{
+  public:
+  bool     ok;
+  UINT64   numInst;
+  UINT64   numCondBranch;
+  double   wallSecs;
+  vector<UINT64> numMispred;   // one per predictor, in NumPredictors order
+  vector<UINT64> numTargetLookups;   // one per target predictor, in
+  vector<UINT64> numTargetMispred;   // NumTargetPredictors order
+
+  TRACE_RESULT(){
+    ok=false;
+    numInst=0;
+    numCondBranch=0;
+    wallSecs=0;
+  }
+};
+
+// Trace position a snapshot was taken at
+class SNAPSHOT_POSITION{
+  public:
+  UINT64   numInst;
+  UINT64   numCondBranch;
+};
+
+/////////////////////////////////////////////////////////////
+
+// main.cc
+int         NumPredictors();
+const char *PredictorName(int index);
+int         NumTargetPredictors();
+const char *TargetPredictorName(int index);
+void        RunTrace(char *traceName, bool threaded, bool heartBeat, TRACE_RESULT *result);
+bool        SaveSnapshot(char *fileName, SNAPSHOT_POSITION pos);
+bool        LoadSnapshot(char *fileName, SNAPSHOT_POSITION *pos);
+
+// batch.cc
+int         RunBatchMode(char *listName, int jobs, bool threaded, bool json, char *outName);
+
+/////////////////////////////////////////////////////////////
+
+#endif
@@ -14,98 +14,793 @@
 
 
 
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <vector>
 #include "utils.h"
 #include "tracer.h"
 #include "predictor.h"
+#include "target.h"
+#include "batchring.h"
+#include "harness.h"
+#include "profiler.h"
+#include "phase.h"
 
 
-// usage: predictor <trace>
+/////////////////////////////////////////////////////////////
+// Predictors evaluated on every conditional branch
+/////////////////////////////////////////////////////////////
 
-int main(int argc, char* argv[]){
-  
-  if (argc != 2) {
-    printf("usage: %s <trace>\n", argv[0]);
-    exit(-1);
+class PREDICTOR_SLOT{
+  public:
+  BRANCH_PREDICTOR *pred;
+  UINT64 numMispred;
+  PC_MAP<PC_MISSES> *misses;   // per-PC mispredictions, NULL unless profiling
+};
+
+static vector<PREDICTOR_SLOT> predictors;
+
+// Per-branch profile of the single-trace run, NULL unless profiling
+static BRANCH_PROFILER *profiler = NULL;
+
+// Per-interval samples of the single-trace run, NULL unless -interval
+static INTERVAL_SERIES *series = NULL;
+
+/////////////////////////////////////////////////////////////
+// Target predictors evaluated on every control-flow record
+/////////////////////////////////////////////////////////////
+
+class TARGET_SLOT{
+  public:
+  TARGET_PREDICTOR *pred;
+  bool   predicts[OPTYPE_MAX];   // pred->Predicts, per opType
+  UINT64 numLookups;             // taken branches it was asked about
+  UINT64 numMispred;
+};
+
+static vector<TARGET_SLOT> targets;
+
+// Evaluated when no -pred option is given
+static const char *defaultPredictors[] = {"2bitsat", "2level", "openend"};
+
+// Runs one predictor over a batch of conditional branches
+static void RunBatch(PREDICTOR_SLOT *p, const CBP_TRACE_RECORD *br, UINT32 n){
+  BRANCH_PREDICTOR *pred = p->pred;
+  for (UINT32 i = 0; i < n; i++) {
+    bool predDir = pred->GetPrediction(br[i].PC);
+    pred->UpdatePredictor(br[i].PC, br[i].branchTaken, predDir, br[i].branchTarget);
+    if(predDir != br[i].branchTaken){
+      p->numMispred++; // update mispred stats
+      if (p->misses) p->misses->Insert(br[i].PC)->count++;
+    }
   }
-  
+}
+
+// Worker thread: consumes every batch from the ring for the predictors
+// numbered consumer, consumer + numWorkers, ...
+static void RunWorker(BATCH_RING *ring, int consumer, int numWorkers){
+  const CBP_TRACE_RECORD *br;
+  UINT32 n;
+  while ((br = ring->Next(consumer, &n)) != NULL) {
+    for (size_t p = consumer; p < predictors.size(); p += numWorkers) {
+      RunBatch(&predictors[p], br, n);
+    }
+    ring->Release(consumer);
+  }
+}
+
+// Runs one target predictor over a decoded batch. Calls, returns, jumps
+// and indirect branches are always taken.
+static void RunTargetBatch(TARGET_SLOT *t, const CBP_TRACE_RECORD *rec, UINT32 n){
+  TARGET_PREDICTOR *pred = t->pred;
+  for (UINT32 i = 0; i < n; i++) {
+    OpType opType = rec[i].opType;
+    if (opType < OPTYPE_CALL_DIRECT || opType >= OPTYPE_MAX) continue;
+    bool taken = (opType != OPTYPE_BRANCH_COND) || rec[i].branchTaken;
+    if (taken && t->predicts[opType]) {
+      t->numLookups++;
+      if (pred->GetTarget(rec[i].PC, opType) != rec[i].branchTarget) t->numMispred++;
+    }
+    pred->Update(rec[i].PC, opType, taken, rec[i].branchTarget);
+  }
+}
+
+// Copies the conditional branches of a decoded batch into dst
+static UINT32 FilterCondBranches(const CBP_TRACE_RECORD *src, UINT32 n, CBP_TRACE_RECORD *dst){
+  UINT32 numBr = 0;
+  for (UINT32 i = 0; i < n; i++) {
+    if(src[i].opType == OPTYPE_BRANCH_COND){
+      dst[numBr++] = src[i];
+    }
+  }
+  return numBr;
+}
+
+
+int NumPredictors(){
+  return predictors.size();
+}
+
+const char *PredictorName(int index){
+  return predictors[index].pred->GetName();
+}
+
+int NumTargetPredictors(){
+  return targets.size();
+}
+
+const char *TargetPredictorName(int index){
+  return targets[index].pred->GetName();
+}
+
+/////////////////////////////////////////////////////////////
+// Runs every predictor over one trace
+/////////////////////////////////////////////////////////////
+
+// Drives every predictor until the tracer reports the end of the trace
+// (or of the current instruction limit)
+static void RunPhase(CBP_TRACER *tracer, CBP_TRACE_RECORD *batch, bool threaded){
+    UINT32 batchSize, numBr;
+    int i, numPred = predictors.size();
+
+    if (!threaded) {
+      CBP_TRACE_RECORD *br = new CBP_TRACE_RECORD[CBP_TRACE_BATCH_SIZE];
+      while ((batchSize = tracer->GetNextBatch(batch, CBP_TRACE_BATCH_SIZE)) > 0) {
+        numBr = FilterCondBranches(batch, batchSize, br);
+        if (profiler) profiler->CountBranches(br, numBr);
+        if (series) series->CountBranches(br, numBr);
+        for (i = 0; i < numPred; i++) {
+          RunBatch(&predictors[i], br, numBr);
+        }
+        for (size_t t = 0; t < targets.size(); t++) {
+          RunTargetBatch(&targets[t], batch, batchSize);
+        }
+      }
+      delete [] br;
+    } else {
+      // Each predictor instance keeps its own state, so they can run
+      // concurrently over the same batches with identical results
+      int numWorkers = numPred < BATCH_RING_MAX_CONSUMERS ? numPred : BATCH_RING_MAX_CONSUMERS;
+      BATCH_RING *ring = new BATCH_RING(numWorkers);
+      std::vector<std::thread> workers;
+      for (i = 0; i < numWorkers; i++) {
+        workers.push_back(std::thread(RunWorker, ring, i, numWorkers));
+      }
+      while ((batchSize = tracer->GetNextBatch(batch, CBP_TRACE_BATCH_SIZE)) > 0) {
+        CBP_TRACE_RECORD *br = ring->Acquire();
+        numBr = FilterCondBranches(batch, batchSize, br);
+        if (profiler) profiler->CountBranches(br, numBr);
+        if (series) series->CountBranches(br, numBr);
+        if (numBr > 0) {
+          ring->Publish(numBr);
+        }
+        // Target predictors need every record, not just the published
+        // conditional branches, so they run here while the workers predict
+        for (size_t t = 0; t < targets.size(); t++) {
+          RunTargetBatch(&targets[t], batch, batchSize);
+        }
+      }
+      ring->Finish();
+      for (i = 0; i < numWorkers; i++) {
+        workers[i].join();
+      }
+      delete ring;
+    }
+}
+
+// Decodes, without predicting, up to instruction inst
+static void FastForward(CBP_TRACER *tracer, CBP_TRACE_RECORD *batch, UINT64 inst){
+    tracer->SetInstLimit(inst);
+    while (tracer->GetNextBatch(batch, CBP_TRACE_BATCH_SIZE) > 0) {}
+}
+
+// Measures up to instruction end in intervals of series->intervalInst,
+// closing a sample after each
+static void RunIntervals(CBP_TRACER *tracer, CBP_TRACE_RECORD *batch, bool threaded, UINT64 end){
+    vector<UINT64> last(predictors.size(), 0), delta(predictors.size());
+
+    series->Clear();
+    while (tracer->GetNumInst() < end) {
+      UINT64 first = tracer->GetNumInst();
+      UINT64 firstBr = tracer->GetNumCondBranch();
+      tracer->SetInstLimit((end - first > series->intervalInst) ? first + series->intervalInst : end);
+      RunPhase(tracer, batch, threaded);
+      if (tracer->GetNumInst() == first) break;
+      for (size_t p = 0; p < predictors.size(); p++) {
+        delta[p] = predictors[p].numMispred - last[p];
+        last[p] = predictors[p].numMispred;
+      }
+      series->EndInterval(first, tracer->GetNumInst() - first, tracer->GetNumCondBranch() - firstBr, delta);
+    }
+}
+
+static void InitPredictors(){
+    for (size_t i = 0; i < predictors.size(); i++) {
+      predictors[i].pred->Init();
+    }
+    for (size_t t = 0; t < targets.size(); t++) {
+      targets[t].pred->Init();
+    }
+}
+
+static void ResetStats(){
+    for (size_t i = 0; i < predictors.size(); i++) {
+      predictors[i].numMispred = 0;
+    }
+    for (size_t t = 0; t < targets.size(); t++) {
+      targets[t].numLookups = 0;
+      targets[t].numMispred = 0;
+    }
+    if (profiler) profiler->Clear();
+}
+
+/*
+	A run has up to three phases, each ending at an instruction count:
+	fast-forward to the position a loaded snapshot was taken at (decode
+	only), warm up for warmupInst instructions (predict and train, not
+	counted), then measure for measureInst instructions (0 = to the end).
+	The state saved with -save-state is the one measurement starts from.
+*/
+static UINT64 warmupInst = 0;
+static UINT64 measureInst = 0;
+static char  *loadState = NULL;
+static char  *saveState = NULL;
+
+// Simulation points to run instead of the whole trace (-simpoints)
+static vector<SIMPOINT> simpoints;
+static UINT64 simpointInst = 0;    // instructions the points stand for
+
+/*
+	Each point starts from cold predictors, warmed on the warmupInst
+	instructions before it (fewer if the previous point is closer), and
+	the mispredictions and branches per instruction measured on it are
+	weighted by its phase's share and scaled to simpointInst.
+*/
+static void RunSimpoints(CBP_TRACER *tracer, CBP_TRACE_RECORD *batch, bool threaded, TRACE_RESULT *result){
+    int i, numPred = predictors.size(), numTarget = targets.size();
+    vector<double> mispredRate(numPred, 0.0);
+    vector<double> lookupRate(numTarget, 0.0), targetMispredRate(numTarget, 0.0);
+    double branchRate = 0.0;
+
+    for (size_t s = 0; s < simpoints.size(); s++) {
+      const SIMPOINT &pt = simpoints[s];
+      UINT64 warmStart = (pt.firstInst > warmupInst) ? pt.firstInst - warmupInst : 0;
+
+      if (pt.firstInst < tracer->GetNumInst()) {
+        printf("Simulation points overlap at instruction %llu. Dying\n", pt.firstInst);
+        exit(-1);
+      }
+      if (warmStart < tracer->GetNumInst()) warmStart = tracer->GetNumInst();
+      FastForward(tracer, batch, warmStart);
+
+      InitPredictors();
+      tracer->SetInstLimit(pt.firstInst);
+      RunPhase(tracer, batch, threaded);
+
+      ResetStats();
+      UINT64 firstBr = tracer->GetNumCondBranch();
+      tracer->SetInstLimit(pt.firstInst + pt.numInst);
+      RunPhase(tracer, batch, threaded);
+      if (tracer->GetNumInst() != pt.firstInst + pt.numInst) {
+        printf("Trace ends before simulation point at instruction %llu. Dying\n", pt.firstInst);
+        exit(-1);
+      }
+
+      for (i = 0; i < numPred; i++) {
+        mispredRate[i] += pt.weight * predictors[i].numMispred / pt.numInst;
+      }
+      for (i = 0; i < numTarget; i++) {
+        lookupRate[i] += pt.weight * targets[i].numLookups / pt.numInst;
+        targetMispredRate[i] += pt.weight * targets[i].numMispred / pt.numInst;
+      }
+      branchRate += pt.weight * (tracer->GetNumCondBranch() - firstBr) / pt.numInst;
+    }
+
+    result->numInst = simpointInst;
+    result->numCondBranch = (UINT64)(branchRate * simpointInst + 0.5);
+    result->numMispred.clear();
+    for (i = 0; i < numPred; i++) {
+      result->numMispred.push_back((UINT64)(mispredRate[i] * simpointInst + 0.5));
+    }
+    result->numTargetLookups.clear();
+    result->numTargetMispred.clear();
+    for (i = 0; i < numTarget; i++) {
+      result->numTargetLookups.push_back((UINT64)(lookupRate[i] * simpointInst + 0.5));
+      result->numTargetMispred.push_back((UINT64)(targetMispredRate[i] * simpointInst + 0.5));
+    }
+}
+
+void RunTrace(char *traceName, bool threaded, bool heartBeat, TRACE_RESULT *result){
+
   ///////////////////////////////////////////////
   // Init variables
   ///////////////////////////////////////////////
     
-    CBP_TRACER *tracer = new CBP_TRACER(argv[1]);
-    CBP_TRACE_RECORD *trace = new CBP_TRACE_RECORD();
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    CBP_TRACER *tracer = new CBP_TRACER(traceName);
+    CBP_TRACE_RECORD *batch = new CBP_TRACE_RECORD[CBP_TRACE_BATCH_SIZE];
+    int i, numPred = predictors.size();
 
-    UINT64     numMispred_2bitsat =0;  
-    UINT64     numMispred_2level =0;  
-    UINT64     numMispred_openend =0;  
+    tracer->SetHeartBeat(heartBeat);
 
-    InitPredictor_2bitsat();
-    InitPredictor_2level();
-    InitPredictor_openend();
+    if (!targets.empty() && tracer->IsBranchOnly()) {
+      printf("%s holds conditional branches only; target predictors need the full trace. Dying\n", traceName);
+      exit(-1);
+    }
+
+    InitPredictors();
+
+    if (!simpoints.empty()) {
+      RunSimpoints(tracer, batch, threaded, result);
+      gettimeofday(&end, NULL);
+      result->ok = true;
+      result->wallSecs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+      delete [] batch;
+      delete tracer;
+      return;
+    }
+
+    if (loadState != NULL) {
+      SNAPSHOT_POSITION pos;
+      if (!LoadSnapshot(loadState, &pos)) {
+        printf("Unable to load predictor state from %s. Dying\n", loadState);
+        exit(-1);
+      }
+      FastForward(tracer, batch, pos.numInst);
+      if (tracer->GetNumInst() != pos.numInst || tracer->GetNumCondBranch() != pos.numCondBranch) {
+        printf("%s was not saved from this trace. Dying\n", loadState);
+        exit(-1);
+      }
+    }
+
+    if (warmupInst > 0) {
+      ResetStats();
+      tracer->SetInstLimit(tracer->GetNumInst() + warmupInst);
+      RunPhase(tracer, batch, threaded);
+    }
+
+    if (saveState != NULL) {
+      SNAPSHOT_POSITION pos;
+      pos.numInst = tracer->GetNumInst();
+      pos.numCondBranch = tracer->GetNumCondBranch();
+      if (!SaveSnapshot(saveState, pos)) {
+        printf("Unable to save predictor state to %s. Dying\n", saveState);
+        exit(-1);
+      }
+    }
     
   ///////////////////////////////////////////////
   // read each trace recod, simulate until done
   ///////////////////////////////////////////////
 
-      while (tracer->GetNextRecord(trace)) {
-
-	if(trace->opType == OPTYPE_BRANCH_COND){
-      bool predDir_2bitsat;
-      bool predDir_2level;
-      bool predDir_openend;
-
-      // 2bitsat
-	  predDir_2bitsat = GetPrediction_2bitsat(trace->PC);
-
-      // 2level
-	  predDir_2level = GetPrediction_2level(trace->PC);
-
-      // openend
-	  predDir_openend = GetPrediction_openend(trace->PC);
-
-      // 2bitsat
-	  UpdatePredictor_2bitsat(trace->PC, trace->branchTaken, 
-				  predDir_2bitsat, trace->branchTarget);
-	  
-	  if(predDir_2bitsat != trace->branchTaken){
-	    numMispred_2bitsat++; // update mispred stats
-	  }
-	  
-      // 2level
-	  UpdatePredictor_2level(trace->PC, trace->branchTaken, 
-				  predDir_2level, trace->branchTarget);
-	  
-	  if(predDir_2level != trace->branchTaken){
-	    numMispred_2level++; // update mispred stats
-	  }
-	  
-      // openend
-	  UpdatePredictor_openend(trace->PC, trace->branchTaken, 
-				  predDir_openend, trace->branchTarget);
-	  
-	  if(predDir_openend != trace->branchTaken){
-	    numMispred_openend++; // update mispred stats
-	  }
-	  
-	}
-      
-      }
+    UINT64 firstInst = tracer->GetNumInst();
+    UINT64 firstCondBranch = tracer->GetNumCondBranch();
+
+    ResetStats();
+    if (series == NULL) {
+      tracer->SetInstLimit(measureInst > 0 ? firstInst + measureInst : ~0ULL);
+      RunPhase(tracer, batch, threaded);
+    } else {
+      RunIntervals(tracer, batch, threaded, measureInst > 0 ? firstInst + measureInst : ~0ULL);
+    }
+
+    gettimeofday(&end, NULL);
+
+    result->ok = true;
+    result->numInst = tracer->GetNumInst() - firstInst;
+    result->numCondBranch = tracer->GetNumCondBranch() - firstCondBranch;
+    result->wallSecs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    result->numMispred.clear();
+    for (i = 0; i < numPred; i++) {
+      result->numMispred.push_back(predictors[i].numMispred);
+    }
+    result->numTargetLookups.clear();
+    result->numTargetMispred.clear();
+    for (size_t t = 0; t < targets.size(); t++) {
+      result->numTargetLookups.push_back(targets[t].numLookups);
+      result->numTargetMispred.push_back(targets[t].numMispred);
+    }
+
+    delete [] batch;
+    delete tracer;
+}
+
+/////////////////////////////////////////////////////////////
+// Predictor state snapshots
+/////////////////////////////////////////////////////////////
+
+/*
+	Layout, native byte order:
+		magic "CBPSNP01", SNAPSHOT_POSITION, UINT32 number of predictors,
+		then per predictor, direction predictors before target predictors:
+		UINT32 spec length, the spec, UINT64 state length and the bytes
+		its Checkpoint produced.
+	On load each predictor of this run takes the state saved under the
+	same spec, so a snapshot only restores identically configured
+	predictors.
+*/
+
+#define SNAPSHOT_MAGIC "CBPSNP01"
+
+template <class PREDICTOR>
+static bool SaveState(FILE *out, PREDICTOR *pred){
+  vector<char> buf;
+  PREDICTOR_STATE state(&buf, false);
+  pred->Checkpoint(state);
+
+  string spec = pred->name;
+  UINT32 specLen = spec.size();
+  UINT64 stateLen = buf.size();
+  return fwrite(&specLen, sizeof(specLen), 1, out) == 1 &&
+         fwrite(spec.data(), 1, specLen, out) == specLen &&
+         fwrite(&stateLen, sizeof(stateLen), 1, out) == 1 &&
+         (stateLen == 0 || fwrite(&buf[0], 1, stateLen, out) == stateLen);
+}
+
+template <class PREDICTOR>
+static bool LoadState(map<string, vector<char> > &saved, PREDICTOR *pred, char *fileName){
+  map<string, vector<char> >::iterator it = saved.find(pred->name);
+  if (it == saved.end()) {
+    printf("No state for %s in %s\n", pred->GetName(), fileName);
+    return false;
+  }
+  PREDICTOR_STATE state(&it->second, true);
+  pred->Checkpoint(state);
+  if (!state.Ok()) {
+    printf("State of %s in %s does not match its configuration\n", pred->GetName(), fileName);
+    return false;
+  }
+  return true;
+}
+
+bool SaveSnapshot(char *fileName, SNAPSHOT_POSITION pos){
+  FILE *out = fopen(fileName, "wb");
+  UINT32 count = predictors.size() + targets.size();
+  bool ok;
+
+  if (out == NULL) return false;
+  ok = fwrite(SNAPSHOT_MAGIC, 8, 1, out) == 1 &&
+       fwrite(&pos, sizeof(pos), 1, out) == 1 &&
+       fwrite(&count, sizeof(count), 1, out) == 1;
+
+  for (size_t i = 0; ok && i < predictors.size(); i++) {
+    ok = SaveState(out, predictors[i].pred);
+  }
+  for (size_t t = 0; ok && t < targets.size(); t++) {
+    ok = SaveState(out, targets[t].pred);
+  }
+
+  return (fclose(out) == 0) && ok;
+}
+
+bool LoadSnapshot(char *fileName, SNAPSHOT_POSITION *pos){
+  FILE *in = fopen(fileName, "rb");
+  map<string, vector<char> > saved;
+  char magic[8];
+  UINT32 count;
+
+  if (in == NULL) return false;
+  if (fread(magic, 8, 1, in) != 1 || memcmp(magic, SNAPSHOT_MAGIC, 8) != 0 ||
+      fread(pos, sizeof(*pos), 1, in) != 1 ||
+      fread(&count, sizeof(count), 1, in) != 1) {
+    fclose(in);
+    return false;
+  }
+
+  bool ok = true;
+  for (UINT32 i = 0; ok && i < count; i++) {
+    UINT32 specLen;
+    UINT64 stateLen;
+    ok = fread(&specLen, sizeof(specLen), 1, in) == 1;
+    string spec(ok ? specLen : 0, '\0');
+    ok = ok && (specLen == 0 || fread(&spec[0], 1, specLen, in) == specLen) &&
+         fread(&stateLen, sizeof(stateLen), 1, in) == 1;
+    if (!ok) break;
+    vector<char> &buf = saved[spec];
+    buf.resize(stateLen);
+    ok = (stateLen == 0 || fread(&buf[0], 1, stateLen, in) == stateLen);
+  }
+  fclose(in);
+  if (!ok) return false;
+
+  for (size_t i = 0; i < predictors.size(); i++) {
+    if (!LoadState(saved, predictors[i].pred, fileName)) return false;
+  }
+  for (size_t t = 0; t < targets.size(); t++) {
+    if (!LoadState(saved, targets[t].pred, fileName)) return false;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////
+// Hardware budget limits
+/////////////////////////////////////////////////////////////
+
+// Configurations over -max-bits or -max-cycles are dropped before any
+// trace is read; 0 means no limit
+static double clockGHz = 3.0;
+static UINT64 maxBits = 0;
+static int    maxCycles = 0;
+
+// N, NK or NM bits
+static UINT64 ParseBits(const char *s){
+  char *end;
+  UINT64 bits = strtoull(s, &end, 0);
+  if (*end == 'K' || *end == 'k') bits <<= 10;
+  else if (*end == 'M' || *end == 'm') bits <<= 20;
+  return bits;
+}
+
+template <class PREDICTOR>
+static bool FitsBudget(PREDICTOR *pred){
+  STORAGE_BUDGET budget;
+  pred->Storage(budget);
+  UINT64 bits = budget.TotalBits();
+  int cycles = AccessCycles(EstimateAccess(budget), clockGHz);
+  if ((maxBits > 0 && bits > maxBits) || (maxCycles > 0 && cycles > maxCycles)) {
+    fprintf(stderr, "Skipping %s: %llu bits, %d cycle%s at %.2f GHz\n",
+            pred->GetName(), bits, cycles, cycles == 1 ? "" : "s", clockGHz);
+    return false;
+  }
+  return true;
+}
+
+template <class PREDICTOR>
+static void PrintPredictorBudget(PREDICTOR *pred){
+  STORAGE_BUDGET budget;
+  pred->Storage(budget);
+  PrintBudget(stdout, pred->GetName(), budget, clockGHz);
+}
+
+
+// usage: predictor [-threads] [-pred <spec>]... [-target <spec>]...
+//                  [-profile N] [-profile-csv <file>]
+//                  [-warmup N] [-measure M] [-load-state <file>] [-save-state <file>]
+//                  [-interval K [-series <file>] [-simpoints-out <file>]] <trace>
+//        predictor [-threads] [-pred <spec>]... [-target <spec>]...
+//                  [-warmup N] -simpoints <file> <trace>
+//        predictor [-threads] [-pred <spec>]... [-target <spec>]...
+//                  [-warmup N] [-measure M] [-jobs N] [-json] [-o <file>] -batch <dir|list>
+//        predictor [-pred <spec>]... [-target <spec>]... [-clock GHz] -budget
+//        predictor -list
+//   -pred      evaluate a predictor built from "family[:key=value]...",
+//              e.g. -pred 2bitsat:entries=16384 -pred 2level:bht=1024:hist=8;
+//              repeat to sweep many configurations in one trace pass
+//              (default: 2bitsat, 2level and openend)
+//   -target    also evaluate a branch target predictor (btb, ras, ittage)
+//              on every call, return, jump and taken branch of the same
+//              trace pass, each with its own lookups and target misses;
+//              needs a full trace, not a branch file
+//   -list      print the registered predictor families and their parameters
+//   -budget    print each predictor's storage, table by table, and the
+//              access latency, read energy and area the analytic SRAM
+//              model in budget.cc estimates at -clock GHz (default 3)
+//   -max-bits  skip predictors of more than N bits (N, NK or NM)
+//   -max-cycles   skip predictors whose estimated access takes more than
+//              N cycles at -clock GHz
+//   -profile   count executions, taken outcomes and per-predictor misses
+//              of every static branch and report the N worst offenders,
+//              the cumulative-miss curve and mispredictions by taken bias
+//   -profile-csv  also write the whole per-branch profile to <file>
+//   -warmup    run N instructions (after the -load-state position, if
+//              any) that train the predictors but are not counted
+//   -measure   count only the next M instructions (default: to the end)
+//   -save-state   write every predictor's state, as of the start of the
+//              measured interval, to <file>
+//   -load-state   start from the state in <file> instead of cold tables,
+//              fast-forwarding the trace to where it was saved
+//   -interval  sample every predictor's mispredictions every K measured
+//              instructions and write the series as CSV to <file> (or
+//              stdout), with each interval's phase: intervals are grouped
+//              by the working set of conditional branch PCs
+//   -simpoints-out  write one representative interval per phase, and
+//              its weight, to <file>
+//   -simpoints    run only the points listed in <file>, each warmed for
+//              N instructions, and report whole-trace estimates
+//   -threads   decode the trace once on the main thread and run the
+//              predictors on worker threads
+//   -batch     run every trace in a directory, or listed one per line in
+//              a file, on a pool of N worker processes (default: one per
+//              core) and write a CSV (or JSON) summary to <file> or stdout
+
+static void Usage(char *prog){
+  printf("usage: %s [-threads] [-pred <spec>]... [-target <spec>]...\n", prog);
+  printf("         [-profile N] [-profile-csv <file>]\n");
+  printf("         [-warmup N] [-measure M] [-load-state <file>] [-save-state <file>]\n");
+  printf("         [-interval K [-series <file>] [-simpoints-out <file>]] <trace>\n");
+  printf("       %s [-threads] [-pred <spec>]... [-target <spec>]...\n", prog);
+  printf("         [-warmup N] -simpoints <file> <trace>\n");
+  printf("       %s [-threads] [-pred <spec>]... [-target <spec>]...\n", prog);
+  printf("         [-warmup N] [-measure M] [-jobs N] [-json] [-o <file>] -batch <dir|list>\n");
+  printf("       %s [-pred <spec>]... [-target <spec>]... [-clock GHz] -budget\n", prog);
+  printf("       %s -list\n", prog);
+  printf("  -max-bits N and -max-cycles N [-clock GHz] skip predictors over budget\n");
+  exit(-1);
+}
+
+int main(int argc, char* argv[]){
+  
+  bool threaded = false;
+  bool json = false;
+  int  jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  char *batchList = NULL;
+  char *outName = NULL;
+  char *traceName = NULL;
+  char *profileCsv = NULL;
+  int  profileTop = 0;
+  UINT64 interval = 0;
+  char *seriesName = NULL;
+  char *simpointsOut = NULL;
+  char *simpointsIn = NULL;
+  vector<char *> specs;
+  vector<char *> targetSpecs;
+  bool budget = false;
+
+  for (int arg = 1; arg < argc; arg++) {
+    // --option is accepted as well as -option
+    if (argv[arg][0] == '-' && argv[arg][1] == '-') argv[arg]++;
+    if (!strcmp(argv[arg], "-threads")) threaded = true;
+    else if (!strcmp(argv[arg], "-json")) json = true;
+    else if (!strcmp(argv[arg], "-list")) {
+      printf("direction predictors (-pred):\n");
+      PREDICTOR_REGISTRY::List(stdout);
+      printf("target predictors (-target):\n");
+      TARGET_REGISTRY::List(stdout);
+      return 0;
+    }
+    else if (!strcmp(argv[arg], "-pred") && arg + 1 < argc) specs.push_back(argv[++arg]);
+    else if (!strcmp(argv[arg], "-target") && arg + 1 < argc) targetSpecs.push_back(argv[++arg]);
+    else if (!strcmp(argv[arg], "-budget")) budget = true;
+    else if (!strcmp(argv[arg], "-clock") && arg + 1 < argc) clockGHz = atof(argv[++arg]);
+    else if (!strcmp(argv[arg], "-max-bits") && arg + 1 < argc) maxBits = ParseBits(argv[++arg]);
+    else if (!strcmp(argv[arg], "-max-cycles") && arg + 1 < argc) maxCycles = atoi(argv[++arg]);
+    else if (!strcmp(argv[arg], "-jobs") && arg + 1 < argc) jobs = atoi(argv[++arg]);
+    else if (!strcmp(argv[arg], "-o") && arg + 1 < argc) outName = argv[++arg];
+    else if (!strcmp(argv[arg], "-profile") && arg + 1 < argc) profileTop = atoi(argv[++arg]);
+    else if (!strcmp(argv[arg], "-profile-csv") && arg + 1 < argc) profileCsv = argv[++arg];
+    else if (!strcmp(argv[arg], "-warmup") && arg + 1 < argc) warmupInst = strtoull(argv[++arg], NULL, 0);
+    else if (!strcmp(argv[arg], "-measure") && arg + 1 < argc) measureInst = strtoull(argv[++arg], NULL, 0);
+    else if (!strcmp(argv[arg], "-load-state") && arg + 1 < argc) loadState = argv[++arg];
+    else if (!strcmp(argv[arg], "-save-state") && arg + 1 < argc) saveState = argv[++arg];
+    else if (!strcmp(argv[arg], "-interval") && arg + 1 < argc) interval = strtoull(argv[++arg], NULL, 0);
+    else if (!strcmp(argv[arg], "-series") && arg + 1 < argc) seriesName = argv[++arg];
+    else if (!strcmp(argv[arg], "-simpoints-out") && arg + 1 < argc) simpointsOut = argv[++arg];
+    else if (!strcmp(argv[arg], "-simpoints") && arg + 1 < argc) simpointsIn = argv[++arg];
+    else if (!strcmp(argv[arg], "-batch") && arg + 1 < argc) batchList = argv[++arg];
+    else if (!traceName && argv[arg][0] != '-') traceName = argv[arg];
+    else Usage(argv[0]);
+  }
+
+  if (specs.empty()) {
+    for (size_t i = 0; i < sizeof(defaultPredictors)/sizeof(defaultPredictors[0]); i++) {
+      specs.push_back((char *)defaultPredictors[i]);
+    }
+  }
+  if (clockGHz <= 0) Usage(argv[0]);
+  for (size_t i = 0; i < specs.size(); i++) {
+    PREDICTOR_SLOT slot;
+    slot.pred = PREDICTOR_REGISTRY::Create(specs[i]);
+    if (!FitsBudget(slot.pred)) {
+      delete slot.pred;
+      continue;
+    }
+    slot.numMispred = 0;
+    slot.misses = NULL;
+    predictors.push_back(slot);
+  }
+  for (size_t i = 0; i < targetSpecs.size(); i++) {
+    TARGET_SLOT slot;
+    slot.pred = TARGET_REGISTRY::Create(targetSpecs[i]);
+    if (!FitsBudget(slot.pred)) {
+      delete slot.pred;
+      continue;
+    }
+    for (int op = 0; op < OPTYPE_MAX; op++) {
+      slot.predicts[op] = slot.pred->Predicts((OpType)op);
+    }
+    slot.numLookups = 0;
+    slot.numMispred = 0;
+    targets.push_back(slot);
+  }
+  if (predictors.empty()) {
+    printf("No predictor fits the budget. Dying\n");
+    exit(-1);
+  }
+
+  if (budget) {
+    for (size_t i = 0; i < predictors.size(); i++) PrintPredictorBudget(predictors[i].pred);
+    for (size_t t = 0; t < targets.size(); t++) PrintPredictorBudget(targets[t].pred);
+    return 0;
+  }
+
+  if (profileTop > 0 || profileCsv != NULL) {
+    if (batchList != NULL) Usage(argv[0]);
+    if (profileTop <= 0) profileTop = 20;
+    profiler = new BRANCH_PROFILER(predictors.size());
+    for (size_t i = 0; i < predictors.size(); i++) {
+      predictors[i].misses = profiler->Misses(i);
+    }
+  }
+
+  if ((seriesName != NULL || simpointsOut != NULL) && interval == 0) Usage(argv[0]);
+  if (interval > 0) {
+    if (batchList != NULL || simpointsIn != NULL) Usage(argv[0]);
+    series = new INTERVAL_SERIES(interval);
+  }
+
+  if (simpointsIn != NULL) {
+    if (batchList != NULL || profiler != NULL || measureInst > 0 || loadState != NULL || saveState != NULL) {
+      Usage(argv[0]);
+    }
+    if (!ReadSimpoints(simpointsIn, &simpointInst, &simpoints)) {
+      printf("Unable to read simulation points from %s. Dying\n", simpointsIn);
+      exit(-1);
+    }
+  }
+
+  if (batchList != NULL) {
+    if (traceName != NULL || jobs < 1 || loadState != NULL || saveState != NULL) Usage(argv[0]);
+    return RunBatchMode(batchList, jobs, threaded, json, outName);
+  }
+
+  if (traceName == NULL) Usage(argv[0]);
+
+  TRACE_RESULT result;
+  RunTrace(traceName, threaded, true, &result);
 
     ///////////////////////////////////////////
     //print_stats
     ///////////////////////////////////////////
 
       printf("\n");
-      printf("\nNUM_INSTRUCTIONS     \t : %10llu",   tracer->GetNumInst());
-      printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   tracer->GetNumCondBranch());
+      printf("\nNUM_INSTRUCTIONS     \t : %10llu",   result.numInst);
+      printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   result.numCondBranch);
+      if (!simpoints.empty()) {
+        printf("\nSIMULATION_POINTS    \t : %10zu",   simpoints.size());
+      }
       printf("\n");
-      printf("\n2bitsat: NUM_MISPREDICTIONS   \t : %10llu",   numMispred_2bitsat);
-      printf("\n2bitsat: MISPRED_PER_1K_INST  \t : %10.3f",   1000.0*(double)(numMispred_2bitsat)/(double)(tracer->GetNumInst()));
-      printf("\n2level:  NUM_MISPREDICTIONS   \t : %10llu",   numMispred_2level);
-      printf("\n2level:  MISPRED_PER_1K_INST  \t : %10.3f",   1000.0*(double)(numMispred_2level)/(double)(tracer->GetNumInst()));
-      printf("\nopenend: NUM_MISPREDICTIONS   \t : %10llu",   numMispred_openend);
-      printf("\nopenend: MISPRED_PER_1K_INST  \t : %10.3f",   1000.0*(double)(numMispred_openend)/(double)(tracer->GetNumInst()));
+      for (int i = 0; i < NumPredictors(); i++) {
+        char label[256];
+        snprintf(label, sizeof(label), "%s:", PredictorName(i));
+        printf("\n%-8s NUM_MISPREDICTIONS   \t : %10llu",   label, result.numMispred[i]);
+        printf("\n%-8s MISPRED_PER_1K_INST  \t : %10.3f",   label, 1000.0*(double)(result.numMispred[i])/(double)(result.numInst));
+      }
+      if (NumTargetPredictors() > 0) printf("\n");
+      for (int t = 0; t < NumTargetPredictors(); t++) {
+        char label[256];
+        snprintf(label, sizeof(label), "%s:", TargetPredictorName(t));
+        printf("\n%-8s NUM_TARGET_LOOKUPS   \t : %10llu",   label, result.numTargetLookups[t]);
+        printf("\n%-8s NUM_TARGET_MISPRED   \t : %10llu",   label, result.numTargetMispred[t]);
+        printf("\n%-8s TARGET_MISP_PER_1K   \t : %10.3f",   label, 1000.0*(double)(result.numTargetMispred[t])/(double)(result.numInst));
+      }
       printf("\n\n");
+
+  if (profiler) {
+    profiler->Report(stdout, profileTop);
+    if (profileCsv != NULL && !profiler->WriteCsv(profileCsv)) {
+      printf("Unable to write %s. Dying\n", profileCsv);
+      exit(-1);
+    }
+    delete profiler;
+  }
+
+  if (series) {
+    series->Classify();
+    if (!series->WriteSeries(seriesName)) {
+      printf("Unable to write %s. Dying\n", seriesName);
+      exit(-1);
+    }
+    if (simpointsOut != NULL && !series->WriteSimpoints(simpointsOut, traceName, result.numInst)) {
+      printf("Unable to write %s. Dying\n", simpointsOut);
+      exit(-1);
+    }
+    delete series;
+  }
+
+  return 0;
 }
 
 
@@ -0,0 +1,394 @@
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "predictor.h"
+
+/* REFERENCES
+
+[1] D. A. Jimenez and C. Lin, "Dynamic Branch Prediction with Perceptrons," in The 7th International Symposium
+	on High-Performance Computer Architecture, 2001.
+
+[2] D. Tarjan and K. Skadron, "Merging Path and Gshare Indexing in Perceptron Branch Prediction," ACM Transactions
+	on Architecture and Code Optimization, vol. 2, no. 3, pp. 280-300, 2005.
+
+[3] A. Seznec, "Analysis of the O-GEometric History Length branch predictor," in The 32nd Annual International
+	Symposium on Computer Architecture, 2005.
+
+*/
+
+/////////////////////////////////////////////////////////////
+// int8 weight kernels
+/////////////////////////////////////////////////////////////
+
+/*
+	Weights are int8 saturating at +-127 (never -128, so a weight times -1
+	always fits in int8). Inputs are int8 of +1 (taken) or -1 (not taken).
+
+	The vector kernels form the products w*x in 8 bits (sign on AVX2, an
+	xor/subtract with the input's sign mask on SSE2), bias them by +128 to
+	unsigned and sum them with SAD against zero, eight bytes per 64-bit
+	lane. 32 inputs per step on AVX2, 16 on SSE2, then a scalar tail. Build
+	with `make SIMD=-mavx2` for the AVX2 path; without SSE2 (non-x86) only
+	the scalar loops are compiled. The scalar kernels give identical
+	results and can be forced with kernel=scalar.
+*/
+
+#define PERCEPTRON_WEIGHT_MAX 127
+
+static int DotScalar(const INT8 *w, const INT8 *x, int n) {
+	int sum = 0;
+	for (int i = 0; i < n; i++)
+		sum += w[i] * x[i];
+	return sum;
+}
+
+static void TrainScalar(INT8 *w, const INT8 *x, int n, bool taken) {
+	for (int i = 0; i < n; i++) {
+		int v = w[i] + (taken ? x[i] : -x[i]);
+		if (v > PERCEPTRON_WEIGHT_MAX) v = PERCEPTRON_WEIGHT_MAX;
+		if (v < -PERCEPTRON_WEIGHT_MAX) v = -PERCEPTRON_WEIGHT_MAX;
+		w[i] = (INT8)v;
+	}
+}
+
+static int DotSimd(const INT8 *w, const INT8 *x, int n) {
+	int i = 0, sum = 0;
+#if defined(__AVX2__)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i bias = _mm256_set1_epi8((char)0x80);
+		__m256i acc = zero;
+		for (; i + 32 <= n; i += 32) {
+			__m256i p = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(w + i)),
+			                             _mm256_loadu_si256((const __m256i *)(x + i)));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_xor_si256(p, bias), zero));
+		}
+		__m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		sum += (int)(_mm_cvtsi128_si64(s) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s))) - 128 * i;
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i bias = _mm_set1_epi8((char)0x80);
+		__m128i acc = zero;
+		int start = i;
+		for (; i + 16 <= n; i += 16) {
+			__m128i wv = _mm_loadu_si128((const __m128i *)(w + i));
+			__m128i m = _mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)(x + i)), zero);
+			__m128i p = _mm_sub_epi8(_mm_xor_si128(wv, m), m);
+			acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_xor_si128(p, bias), zero));
+		}
+		sum += (int)(_mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc))) - 128 * (i - start);
+	}
+#endif
+	return sum + DotScalar(w + i, x + i, n - i);
+}
+
+static void TrainSimd(INT8 *w, const INT8 *x, int n, bool taken) {
+	int i = 0;
+#if defined(__AVX2__)
+	{
+		const __m256i dir = _mm256_set1_epi8(taken ? 1 : -1);
+		const __m256i min = _mm256_set1_epi8(-PERCEPTRON_WEIGHT_MAX);
+		for (; i + 32 <= n; i += 32) {
+			__m256i d = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(x + i)), dir);
+			__m256i v = _mm256_adds_epi8(_mm256_loadu_si256((const __m256i *)(w + i)), d);
+			_mm256_storeu_si256((__m256i *)(w + i), _mm256_max_epi8(v, min));
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i m = taken ? _mm_setzero_si128() : _mm_set1_epi8(-1);
+		const __m128i floor = _mm_set1_epi8(-128);
+		for (; i + 16 <= n; i += 16) {
+			__m128i xv = _mm_loadu_si128((const __m128i *)(x + i));
+			__m128i d = _mm_sub_epi8(_mm_xor_si128(xv, m), m);
+			__m128i v = _mm_adds_epi8(_mm_loadu_si128((const __m128i *)(w + i)), d);
+			// -128 can only come from -127 - 1; move it back to -127
+			v = _mm_sub_epi8(v, _mm_cmpeq_epi8(v, floor));
+			_mm_storeu_si128((__m128i *)(w + i), v);
+		}
+	}
+#endif
+	TrainScalar(w + i, x + i, n - i, taken);
+}
+
+/////////////////////////////////////////////////////////////
+// perceptron
+/////////////////////////////////////////////////////////////
+
+// Multiplicative hash of the PC into a power-of-two table, so aligned
+// or clustered branch addresses still spread over every row
+static UINT32 HashPC(UINT32 PC, UINT32 size) {
+	return ((PC * 0x9E3779B1u) >> 8) & (size - 1);
+}
+
+/*
+	Global/local perceptron [1]. Each row holds a bias weight, one weight
+	per global history bit and one per local history bit. The global
+	history is a ring of +-1 bytes written twice (at head and head+ghist),
+	so the newest ghist outcomes are always contiguous at ring + head and
+	a push is O(1). Local histories are +-1 byte vectors per entry.
+*/
+
+class PERCEPTRON_PREDICTOR : public BRANCH_PREDICTOR {
+ private:
+	UINT32 numRows;
+	int    ghistBits;
+	int    lhistBits;
+	UINT32 lhistEntries;
+	int    rowWeights;      // 1 + ghistBits + lhistBits
+	int    theta;
+	bool   scalar;
+
+	INT8  *weights;         // numRows x rowWeights
+	INT8  *ghist;           // 2 x ghistBits ring
+	int    ghistHead;
+	INT8  *lhist;           // lhistEntries x lhistBits
+
+	// From GetPrediction, for UpdatePredictor
+	INT8  *row;
+	INT8  *local;
+	int    output;
+
+	int Dot(const INT8 *w, const INT8 *x, int n) {
+		return scalar ? DotScalar(w, x, n) : DotSimd(w, x, n);
+	}
+	void Train(INT8 *w, const INT8 *x, int n, bool taken) {
+		if (scalar) TrainScalar(w, x, n, taken);
+		else TrainSimd(w, x, n, taken);
+	}
+
+ public:
+	PERCEPTRON_PREDICTOR(UINT32 rows, int ghistLen, int lhistLen, UINT32 lentries, bool scalarKernel) {
+		numRows = rows;
+		ghistBits = ghistLen;
+		lhistBits = lhistLen;
+		lhistEntries = lentries;
+		rowWeights = 1 + ghistBits + lhistBits;
+		// Training threshold from [1]
+		theta = (int)(1.93 * (ghistBits + lhistBits) + 14);
+		scalar = scalarKernel;
+		weights = new INT8[numRows * rowWeights];
+		ghist = new INT8[2 * ghistBits + 1];
+		lhist = new INT8[lhistEntries * lhistBits + 1];
+	}
+	~PERCEPTRON_PREDICTOR() { delete [] weights; delete [] ghist; delete [] lhist; }
+
+	void Init();
+	bool GetPrediction(UINT32 PC);
+	void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+	void Checkpoint(PREDICTOR_STATE &state) {
+		state.Array(weights, numRows * rowWeights);
+		state.Array(ghist, 2 * ghistBits + 1);
+		state.Field(ghistHead);
+		state.Array(lhist, lhistEntries * lhistBits + 1);
+	}
+	void Storage(STORAGE_BUDGET &budget) {
+		budget.Table("weights", numRows, rowWeights * 8, 0);
+		budget.Register("global history", ghistBits);
+		budget.Table("local histories", lhistEntries, lhistBits, 0);
+	}
+};
+
+void PERCEPTRON_PREDICTOR::Init() {
+	memset(weights, 0, numRows * rowWeights);
+	// Start from an all not-taken history
+	memset(ghist, -1, 2 * ghistBits + 1);
+	memset(lhist, -1, lhistEntries * lhistBits + 1);
+	ghistHead = 0;
+	row = weights;
+	local = lhist;
+	output = 0;
+}
+
+bool PERCEPTRON_PREDICTOR::GetPrediction(UINT32 PC) {
+	row = &weights[HashPC(PC, numRows) * rowWeights];
+	local = &lhist[HashPC(PC ^ 0x5bd1e995u, lhistEntries) * lhistBits];
+	output = row[0]
+	       + Dot(row + 1, ghist + ghistHead, ghistBits)
+	       + Dot(row + 1 + ghistBits, local, lhistBits);
+	return (output >= 0) ? TAKEN : NOT_TAKEN;
+}
+
+void PERCEPTRON_PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+	INT8 x = resolveDir ? 1 : -1;
+
+	// Train on a misprediction or when the output is not confident enough
+	if ((predDir != resolveDir) || (output <= theta && output >= -theta)) {
+		int bias = row[0] + x;
+		if (bias <= PERCEPTRON_WEIGHT_MAX && bias >= -PERCEPTRON_WEIGHT_MAX) row[0] = (INT8)bias;
+		Train(row + 1, ghist + ghistHead, ghistBits, resolveDir);
+		Train(row + 1 + ghistBits, local, lhistBits, resolveDir);
+	}
+
+	// Newest outcome first in both histories
+	if (ghistBits > 0) {
+		ghistHead = (ghistHead == 0) ? ghistBits - 1 : ghistHead - 1;
+		ghist[ghistHead] = x;
+		ghist[ghistHead + ghistBits] = x;
+	}
+	if (lhistBits > 0) {
+		memmove(local + 1, local, lhistBits - 1);
+		local[0] = x;
+	}
+}
+
+static BRANCH_PREDICTOR *CreatePerceptron(PREDICTOR_PARAMS &params) {
+	UINT32 ghistLen = params.GetUInt("ghist", 64);
+	UINT32 lhistLen = params.GetUInt("lhist", 16);
+	string kernel = params.GetString("kernel", "simd");
+	if (ghistLen > 1024 || lhistLen > 1024) {
+		printf("ghist and lhist of perceptron must be at most 1024. Dying\n");
+		exit(-1);
+	}
+	if (kernel != "simd" && kernel != "scalar") {
+		printf("kernel of perceptron must be simd or scalar. Dying\n");
+		exit(-1);
+	}
+	return new PERCEPTRON_PREDICTOR(params.GetPow2("rows", 512), ghistLen, lhistLen,
+	                                params.GetPow2("lentries", 1024), kernel == "scalar");
+}
+
+REGISTER_PREDICTOR(regPerceptron, "perceptron", CreatePerceptron,
+	"global/local perceptron, int8 weights [rows=512:ghist=64:lhist=16:lentries=1024:kernel=simd|scalar]");
+
+/////////////////////////////////////////////////////////////
+// hashedperceptron
+/////////////////////////////////////////////////////////////
+
+/*
+	Hashed perceptron [2] with geometric history lengths [3]. Table t is
+	indexed by the PC hashed with the newest histLen[t] global outcomes and
+	contributes a single weight, so there is no input vector to multiply:
+	the output is the sum of one weight per table. The weights are
+	gathered from scattered rows, so this predictor uses scalar code; its
+	cost grows with the number of tables, not with the history length.
+*/
+
+#define HASHED_PERCEPTRON_MAX_TABLES 32
+#define HASHED_PERCEPTRON_MAX_HIST   1024
+
+class HASHED_PERCEPTRON_PREDICTOR : public BRANCH_PREDICTOR {
+ private:
+	int    numTables;
+	int    logEntries;
+	int    histLen[HASHED_PERCEPTRON_MAX_TABLES];
+	int    theta;
+
+	INT8  *weights;         // numTables x 2^logEntries
+	UINT64 ghr[HASHED_PERCEPTRON_MAX_HIST / 64];
+	int    ghrWords;
+
+	// From GetPrediction, for UpdatePredictor
+	UINT32 index[HASHED_PERCEPTRON_MAX_TABLES];
+	int    output;
+
+	// XOR-fold the newest len history bits down to logEntries bits
+	UINT32 Fold(int len) {
+		UINT32 h = 0;
+		for (int i = 0; i < len; i += 64) {
+			UINT64 v = ghr[i / 64];
+			if (len - i < 64) v &= (1ULL << (len - i)) - 1;
+			for (; v != 0; v >>= logEntries)
+				h ^= (UINT32)v & ((1 << logEntries) - 1);
+		}
+		return h;
+	}
+
+ public:
+	HASHED_PERCEPTRON_PREDICTOR(int tables, int logEntriesLen, int maxHist) {
+		numTables = tables;
+		logEntries = logEntriesLen;
+		// Table 0 sees only the PC; the others lengths grow geometrically up to maxHist
+		histLen[0] = 0;
+		for (int t = 1; t < numTables; t++) {
+			double ratio = (numTables > 2) ? (double)(t - 1) / (numTables - 2) : 1.0;
+			int len = (int)(2.0 * pow((double)maxHist / 2.0, ratio) + 0.5);
+			histLen[t] = (len > histLen[t-1]) ? len : histLen[t-1] + 1;
+		}
+		ghrWords = (histLen[numTables-1] + 63) / 64;
+		if (ghrWords == 0) ghrWords = 1;
+		theta = (int)(1.93 * numTables + 14);
+		weights = new INT8[numTables << logEntries];
+	}
+	~HASHED_PERCEPTRON_PREDICTOR() { delete [] weights; }
+
+	void Init();
+	bool GetPrediction(UINT32 PC);
+	void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+	void Checkpoint(PREDICTOR_STATE &state) {
+		state.Array(weights, numTables << logEntries);
+		state.Array(ghr, ghrWords);
+	}
+	void Storage(STORAGE_BUDGET &budget) {
+		char name[32];
+		for (int t = 0; t < numTables; t++) {
+			snprintf(name, sizeof(name), "weights %d", t);
+			budget.Table(name, 1 << logEntries, 8, 0);
+		}
+		budget.Register("global history", histLen[numTables-1]);
+	}
+};
+
+void HASHED_PERCEPTRON_PREDICTOR::Init() {
+	memset(weights, 0, numTables << logEntries);
+	memset(ghr, 0, sizeof(ghr));
+	memset(index, 0, sizeof(index));
+	output = 0;
+}
+
+bool HASHED_PERCEPTRON_PREDICTOR::GetPrediction(UINT32 PC) {
+	UINT32 mask = (1 << logEntries) - 1;
+	output = 0;
+	for (int t = 0; t < numTables; t++) {
+		UINT32 h = ((PC + t) * 0x9E3779B1u >> (32 - logEntries)) ^ Fold(histLen[t]);
+		index[t] = (t << logEntries) + (h & mask);
+		output += weights[index[t]];
+	}
+	return (output >= 0) ? TAKEN : NOT_TAKEN;
+}
+
+void HASHED_PERCEPTRON_PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+	// Train on a misprediction or when the output is not confident enough
+	if ((predDir != resolveDir) || (output <= theta && output >= -theta)) {
+		for (int t = 0; t < numTables; t++) {
+			INT8 *w = &weights[index[t]];
+			if (resolveDir && *w < PERCEPTRON_WEIGHT_MAX) (*w)++;
+			if (!resolveDir && *w > -PERCEPTRON_WEIGHT_MAX) (*w)--;
+		}
+	}
+
+	for (int i = ghrWords - 1; i > 0; i--)
+		ghr[i] = (ghr[i] << 1) | (ghr[i-1] >> 63);
+	ghr[0] = (ghr[0] << 1) | (UINT64)resolveDir;
+}
+
+static BRANCH_PREDICTOR *CreateHashedPerceptron(PREDICTOR_PARAMS &params) {
+	UINT32 tables = params.GetUInt("tables", 16);
+	UINT32 entries = params.GetPow2("entries", 1024);
+	UINT32 hist = params.GetUInt("hist", 256);
+	if (tables < 1 || tables > HASHED_PERCEPTRON_MAX_TABLES) {
+		printf("tables of hashedperceptron must be 1..%d. Dying\n", HASHED_PERCEPTRON_MAX_TABLES);
+		exit(-1);
+	}
+	if (hist < tables || hist > HASHED_PERCEPTRON_MAX_HIST - HASHED_PERCEPTRON_MAX_TABLES) {
+		printf("hist of hashedperceptron must be tables..%d. Dying\n",
+		       HASHED_PERCEPTRON_MAX_HIST - HASHED_PERCEPTRON_MAX_TABLES);
+		exit(-1);
+	}
+	int logEntries = 0;
+	while ((1U << logEntries) < entries) logEntries++;
+	if (logEntries < 1 || logEntries > 24) {
+		printf("entries of hashedperceptron must be 2..2^24. Dying\n");
+		exit(-1);
+	}
+	return new HASHED_PERCEPTRON_PREDICTOR(tables, logEntries, hist);
+}
+
+REGISTER_PREDICTOR(regHashedPerceptron, "hashedperceptron", CreateHashedPerceptron,
+	"hashed perceptron, geometric histories [tables=16:entries=1024:hist=256]");
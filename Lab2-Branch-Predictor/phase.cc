@@ -0,0 +1,186 @@
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "phase.h"
+#include "harness.h"
+
+/////////////////////////////////////////////////////////////
+// Interval time series and phase classification
+/////////////////////////////////////////////////////////////
+
+INTERVAL_SERIES::INTERVAL_SERIES(UINT64 interval){
+  intervalInst = interval;
+  memset(current, 0, sizeof(current));
+}
+
+void INTERVAL_SERIES::Clear(){
+  samples.clear();
+  simpoints.clear();
+  memset(current, 0, sizeof(current));
+}
+
+void INTERVAL_SERIES::EndInterval(UINT64 firstInst, UINT64 numInst, UINT64 numCondBranch,
+                                  const vector<UINT64> &numMispred){
+  INTERVAL_SAMPLE s;
+  s.firstInst = firstInst;
+  s.numInst = numInst;
+  s.numCondBranch = numCondBranch;
+  s.numMispred = numMispred;
+  memcpy(s.signature, current, sizeof(current));
+  s.phase = -1;
+  samples.push_back(s);
+  memset(current, 0, sizeof(current));
+}
+
+/////////////////////////////////////////////////////////////
+
+// Signature as fractions of the interval's branch executions
+static void Normalize(const UINT32 *signature, double *v){
+  UINT64 total = 0;
+  for (int b = 0; b < PHASE_BUCKETS; b++) total += signature[b];
+  for (int b = 0; b < PHASE_BUCKETS; b++) v[b] = total ? (double)signature[b] / total : 0.0;
+}
+
+static double Distance(const double *a, const double *b){
+  double d = 0;
+  for (int i = 0; i < PHASE_BUCKETS; i++) d += fabs(a[i] - b[i]);
+  return d;
+}
+
+void INTERVAL_SERIES::Classify(){
+  vector<vector<double> > leaders;     // first interval of each phase
+  vector<vector<double> > centroids;
+  vector<UINT64> phaseInst;
+  vector<int> phaseSize;
+  UINT64 totalInst = 0;
+  double v[PHASE_BUCKETS];
+  size_t i;
+  int p, b;
+
+  // Leader clustering: join the nearest phase within the threshold, or
+  // start a new one
+  for (i = 0; i < samples.size(); i++) {
+    Normalize(samples[i].signature, v);
+    int best = -1;
+    double bestDist = PHASE_THRESHOLD;
+    for (p = 0; p < (int)leaders.size(); p++) {
+      double d = Distance(v, &leaders[p][0]);
+      if (d <= bestDist) { best = p; bestDist = d; }
+    }
+    if (best < 0) {
+      best = leaders.size();
+      leaders.push_back(vector<double>(v, v + PHASE_BUCKETS));
+      centroids.push_back(vector<double>(PHASE_BUCKETS, 0.0));
+      phaseInst.push_back(0);
+      phaseSize.push_back(0);
+    }
+    samples[i].phase = best;
+    for (b = 0; b < PHASE_BUCKETS; b++) centroids[best][b] += v[b];
+    phaseInst[best] += samples[i].numInst;
+    phaseSize[best]++;
+    totalInst += samples[i].numInst;
+  }
+
+  for (p = 0; p < (int)centroids.size(); p++) {
+    for (b = 0; b < PHASE_BUCKETS; b++) centroids[p][b] /= phaseSize[p];
+  }
+
+  // The member nearest its centroid represents each phase
+  simpoints.clear();
+  vector<double> bestDist(leaders.size(), 1e9);
+  simpoints.resize(leaders.size());
+  for (i = 0; i < samples.size(); i++) {
+    p = samples[i].phase;
+    Normalize(samples[i].signature, v);
+    double d = Distance(v, &centroids[p][0]);
+    if (d < bestDist[p]) {
+      bestDist[p] = d;
+      simpoints[p].phase = p;
+      simpoints[p].interval = i;
+      simpoints[p].firstInst = samples[i].firstInst;
+      simpoints[p].numInst = samples[i].numInst;
+      simpoints[p].weight = totalInst ? (double)phaseInst[p] / totalInst : 0.0;
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////
+
+bool INTERVAL_SERIES::WriteSeries(const char *fileName){
+  FILE *out = stdout;
+  size_t p, numPred = samples.empty() ? 0 : samples[0].numMispred.size();
+
+  if (fileName != NULL && strcmp(fileName, "-") != 0) {
+    if ((out = fopen(fileName, "w")) == NULL) return false;
+  }
+
+  fprintf(out, "interval,first_instruction,num_instructions,num_conditional_br,phase");
+  for (p = 0; p < numPred; p++) {
+    fprintf(out, ",%s_mispredictions,%s_mpki", PredictorName(p), PredictorName(p));
+  }
+  fprintf(out, "\n");
+
+  for (size_t i = 0; i < samples.size(); i++) {
+    const INTERVAL_SAMPLE &s = samples[i];
+    fprintf(out, "%zu,%llu,%llu,%llu,%d", i, s.firstInst, s.numInst, s.numCondBranch, s.phase);
+    for (p = 0; p < numPred; p++) {
+      fprintf(out, ",%llu,%.3f", s.numMispred[p], s.numInst ? 1000.0 * s.numMispred[p] / s.numInst : 0.0);
+    }
+    fprintf(out, "\n");
+  }
+
+  return (out == stdout) ? true : (fclose(out) == 0);
+}
+
+/*
+	Simulation point file:
+		# simpoints <trace>
+		total_instructions <N>
+		<phase> <interval> <first instruction> <instructions> <weight>
+		...
+*/
+
+bool INTERVAL_SERIES::WriteSimpoints(const char *fileName, const char *traceName, UINT64 totalInst){
+  FILE *out = fopen(fileName, "w");
+  if (out == NULL) return false;
+
+  fprintf(out, "# simpoints %s\n", traceName);
+  fprintf(out, "total_instructions %llu\n", totalInst);
+  for (size_t p = 0; p < simpoints.size(); p++) {
+    const SIMPOINT &s = simpoints[p];
+    fprintf(out, "%d %llu %llu %llu %.6f\n", s.phase, s.interval, s.firstInst, s.numInst, s.weight);
+  }
+
+  return fclose(out) == 0;
+}
+
+static bool EarlierPoint(const SIMPOINT &a, const SIMPOINT &b){
+  return a.firstInst < b.firstInst;
+}
+
+bool ReadSimpoints(const char *fileName, UINT64 *totalInst, vector<SIMPOINT> *points){
+  FILE *in = fopen(fileName, "r");
+  char line[1024];
+  bool haveTotal = false;
+
+  if (in == NULL) return false;
+  points->clear();
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    SIMPOINT s;
+    if (line[0] == '#' || line[0] == '\n') continue;
+    if (sscanf(line, "total_instructions %llu", totalInst) == 1) {
+      haveTotal = true;
+    } else if (sscanf(line, "%d %llu %llu %llu %lf", &s.phase, &s.interval, &s.firstInst,
+                      &s.numInst, &s.weight) == 5) {
+      points->push_back(s);
+    } else {
+      fclose(in);
+      return false;
+    }
+  }
+  fclose(in);
+
+  sort(points->begin(), points->end(), EarlierPoint);
+  return haveTotal && !points->empty();
+}
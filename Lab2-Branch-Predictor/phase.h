@@ -0,0 +1,81 @@
+#ifndef _PHASE_H_
+#define _PHASE_H_
+
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+
+/////////////////////////////////////////////////////////////
+// Interval time series and phase classification
+/////////////////////////////////////////////////////////////
+
+/*
+	The measured part of a trace is cut into intervals of K instructions.
+	For each interval the harness records every predictor's
+	mispredictions, and the decoding thread builds a signature of the
+	branch-PC working set: conditional branch executions hashed into
+	PHASE_BUCKETS counters. Classify then groups intervals whose
+	normalized signatures lie within PHASE_THRESHOLD (Manhattan distance,
+	0..2) of a phase's first interval, and picks per phase the interval
+	closest to the phase centroid as its simulation point, weighted by the
+	phase's share of the trace's instructions.
+*/
+
+#define PHASE_BUCKETS    32
+#define PHASE_THRESHOLD  0.25
+
+class INTERVAL_SAMPLE{
+  public:
+  UINT64 firstInst;
+  UINT64 numInst;
+  UINT64 numCondBranch;
+  vector<UINT64> numMispred;         // per predictor, this interval only
+  UINT32 signature[PHASE_BUCKETS];   // branch executions per PC bucket
+  int    phase;
+};
+
+class SIMPOINT{
+  public:
+  int    phase;
+  UINT64 interval;     // index in the series
+  UINT64 firstInst;
+  UINT64 numInst;
+  double weight;       // share of the trace's instructions in this phase
+};
+
+class INTERVAL_SERIES{
+ private:
+  UINT32 current[PHASE_BUCKETS];
+
+ public:
+  UINT64 intervalInst;
+  vector<INTERVAL_SAMPLE> samples;
+  vector<SIMPOINT> simpoints;
+
+  INTERVAL_SERIES(UINT64 interval);
+
+  void Clear();
+
+  void CountBranches(const CBP_TRACE_RECORD *br, UINT32 n){
+    for (UINT32 i = 0; i < n; i++) {
+      current[(br[i].PC * 0x9E3779B1u) >> 27]++;
+    }
+  }
+
+  // Closes the interval [firstInst, firstInst + numInst)
+  void EndInterval(UINT64 firstInst, UINT64 numInst, UINT64 numCondBranch,
+                   const vector<UINT64> &numMispred);
+
+  // Assigns phases and picks one simulation point per phase
+  void Classify();
+
+  bool WriteSeries(const char *fileName);
+  bool WriteSimpoints(const char *fileName, const char *traceName, UINT64 totalInst);
+};
+
+// Reads a file written by WriteSimpoints; false if it is malformed
+bool ReadSimpoints(const char *fileName, UINT64 *totalInst, vector<SIMPOINT> *points);
+
+/////////////////////////////////////////////////////////////
+
+#endif // _PHASE_H_
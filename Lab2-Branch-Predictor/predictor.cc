@@ -1,31 +1,114 @@
+#include <string.h>
 #include "predictor.h"
-int bitsat[4096];
+#include "tage.h"
 
-int papbht[512];
-int pappht[8][64];
+/////////////////////////////////////////////////////////////
+// Parameters
+/////////////////////////////////////////////////////////////
+
+bool PREDICTOR_PARAMS::Parse(const char *spec) {
+	string s = spec;
+	size_t pos = s.find(':');
+	family = s.substr(0, pos);
+	if (family.empty()) return false;
+	while (pos != string::npos) {
+		size_t next = s.find(':', pos + 1);
+		string item = s.substr(pos + 1, next == string::npos ? string::npos : next - pos - 1);
+		size_t eq = item.find('=');
+		if (eq == string::npos || eq == 0 || eq == item.size() - 1) return false;
+		values[item.substr(0, eq)] = item.substr(eq + 1);
+		pos = next;
+	}
+	return true;
+}
+
+bool PREDICTOR_PARAMS::Has(const char *key) {
+	return values.count(key) != 0;
+}
+
+UINT32 PREDICTOR_PARAMS::GetUInt(const char *key, UINT32 def) {
+	used.insert(key);
+	if (!Has(key)) return def;
+	char *end;
+	unsigned long v = strtoul(values[key].c_str(), &end, 0);
+	if (*end != '\0') {
+		printf("Bad value %s=%s for %s. Dying\n", key, values[key].c_str(), family.c_str());
+		exit(-1);
+	}
+	return (UINT32)v;
+}
+
+UINT32 PREDICTOR_PARAMS::GetPow2(const char *key, UINT32 def) {
+	UINT32 v = GetUInt(key, def);
+	if (v == 0 || (v & (v - 1)) != 0) {
+		printf("%s of %s must be a power of two. Dying\n", key, family.c_str());
+		exit(-1);
+	}
+	return v;
+}
+
+string PREDICTOR_PARAMS::GetString(const char *key, const char *def) {
+	used.insert(key);
+	return Has(key) ? values[key] : string(def);
+}
+
+void PREDICTOR_PARAMS::CheckUnused() {
+	map<string, string>::iterator it;
+	for (it = values.begin(); it != values.end(); it++) {
+		if (!used.count(it->first)) {
+			printf("Unknown parameter %s for %s. Dying\n", it->first.c_str(), family.c_str());
+			exit(-1);
+		}
+	}
+}
+
+static UINT32 Log2(UINT32 x) {
+	UINT32 n = 0;
+	while (x > 1) { x >>= 1; n++; }
+	return n;
+}
 
 /////////////////////////////////////////////////////////////
 // 2bitsat
 /////////////////////////////////////////////////////////////
-void InitPredictor_2bitsat() {
+
+class BIMODAL_PREDICTOR : public BRANCH_PREDICTOR {
+ private:
+	UINT32 numEntries;
+	int *bitsat;
+
+ public:
+	BIMODAL_PREDICTOR(UINT32 entries) {
+		numEntries = entries;
+		bitsat = new int[numEntries];
+	}
+	~BIMODAL_PREDICTOR() { delete [] bitsat; }
+
+	void Init();
+	bool GetPrediction(UINT32 PC);
+	void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+	void Checkpoint(PREDICTOR_STATE &state) { state.Array(bitsat, numEntries); }
+	void Storage(STORAGE_BUDGET &budget) { budget.Table("counters", numEntries, 2, 0); }
+};
+
+void BIMODAL_PREDICTOR::Init() {
     // Initialize the 2 bit saturated counter to weakly not taken
-    int i;
-    for (i = 0; i < 4096; i++)
+    UINT32 i;
+    for (i = 0; i < numEntries; i++)
         bitsat[i] = 1;    
 }
 
-bool GetPrediction_2bitsat(UINT32 PC) {
-	// Isolate last 12 bits to use as index so PC & (2^13 - 1)//
-	unsigned int num = 4095;
-	unsigned int index = PC & num;
+bool BIMODAL_PREDICTOR::GetPrediction(UINT32 PC) {
+	// Isolate the low log2(entries) bits to use as index
+	unsigned int index = PC & (numEntries - 1);
 	if(bitsat[index] == 0 || bitsat[index] == 1)
 		return NOT_TAKEN;
 	else
 		return TAKEN;
 }
 
-void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
-	unsigned int index = PC & 4095;
+void BIMODAL_PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+	unsigned int index = PC & (numEntries - 1);
 	int state = bitsat[index];
 	if(resolveDir == NOT_TAKEN)
 	{
@@ -39,54 +122,104 @@ void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 br
 	}
 }
 
+static BRANCH_PREDICTOR *Create2bitsat(PREDICTOR_PARAMS &params) {
+	return new BIMODAL_PREDICTOR(params.GetPow2("entries", 4096));
+}
+
+REGISTER_PREDICTOR(reg2bitsat, "2bitsat", Create2bitsat,
+	"bimodal 2-bit counters [entries=4096]");
+
 /////////////////////////////////////////////////////////////
 // 2level
 /////////////////////////////////////////////////////////////
 
-void InitPredictor_2level() {
-   int i, j;
-   for(i = 0; i < 8; i++)
-      for(j = 0; j < 64; j++)
-         pappht[i][j] = 1;
+class PAP_PREDICTOR : public BRANCH_PREDICTOR {
+ private:
+	UINT32 bhtEntries;   // private history registers
+	UINT32 histBits;     // bits per history register
+	UINT32 phtTables;    // private pattern tables, selected by the low PC bits
+	int *papbht;
+	int *pappht;         // phtTables x 2^histBits counters
+
+ public:
+	PAP_PREDICTOR(UINT32 bht, UINT32 hist, UINT32 pht) {
+		bhtEntries = bht;
+		histBits = hist;
+		phtTables = pht;
+		papbht = new int[bhtEntries];
+		pappht = new int[phtTables << histBits];
+	}
+	~PAP_PREDICTOR() { delete [] papbht; delete [] pappht; }
+
+	void Init();
+	bool GetPrediction(UINT32 PC);
+	void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+	void Checkpoint(PREDICTOR_STATE &state) {
+		state.Array(papbht, bhtEntries);
+		state.Array(pappht, phtTables << histBits);
+	}
+	void Storage(STORAGE_BUDGET &budget) {
+		budget.Table("history registers", bhtEntries, histBits, 0);
+		budget.Table("pattern counters", phtTables << histBits, 2, 1);
+	}
+};
+
+void PAP_PREDICTOR::Init() {
+   UINT32 i;
+   for(i = 0; i < (phtTables << histBits); i++)
+      pappht[i] = 1;
    
-   for(i = 0; i < 512; i++)
+   for(i = 0; i < bhtEntries; i++)
         papbht[i] = 0;
 }
 
-bool GetPrediction_2level(UINT32 PC) {
-	unsigned phtIndex = PC & 7;
-	unsigned bhtIndex = (PC >> 3) & 511;
+bool PAP_PREDICTOR::GetPrediction(UINT32 PC) {
+	unsigned phtIndex = PC & (phtTables - 1);
+	unsigned bhtIndex = (PC >> Log2(phtTables)) & (bhtEntries - 1);
 	unsigned pattern = papbht[bhtIndex];
-	unsigned state = pappht[phtIndex][pattern];
+	unsigned state = pappht[(phtIndex << histBits) + pattern];
 	if(state == 0 || state == 1)
 		return NOT_TAKEN;
 	else
 		return TAKEN;
 }
 
-void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
-	unsigned phtIndex = PC & 7;
-	unsigned bhtIndex = (PC >> 3) & 511;
+void PAP_PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+	unsigned phtIndex = PC & (phtTables - 1);
+	unsigned bhtIndex = (PC >> Log2(phtTables)) & (bhtEntries - 1);
 	unsigned oldPattern = papbht[bhtIndex];
+	int *state = &pappht[(phtIndex << histBits) + oldPattern];
 
 	//Update the bi-modal index of the old history
 	if(resolveDir == NOT_TAKEN)
 	{
-		if(pappht[phtIndex][oldPattern] != 0)
-			pappht[phtIndex][oldPattern]--;
+		if(*state != 0)
+			(*state)--;
 	}
 	else
 	{
-	  	if(pappht[phtIndex][oldPattern] != 3)
-		 	pappht[phtIndex][oldPattern]++;
+	  	if(*state != 3)
+		 	(*state)++;
 	}
 
-	// Left shift once (or mul by 2), bitwise AND with 63 (for last 6 bits)
+	// Left shift once (or mul by 2), keep the last histBits bits
 	// and append the resolveDir to the last bit
-	unsigned newPattern = ((oldPattern << 1) & 63) | (unsigned int)resolveDir;
+	unsigned newPattern = ((oldPattern << 1) & ((1 << histBits) - 1)) | (unsigned int)resolveDir;
 	papbht[bhtIndex] = newPattern;  
 }
 
+static BRANCH_PREDICTOR *Create2level(PREDICTOR_PARAMS &params) {
+	UINT32 hist = params.GetUInt("hist", 6);
+	if (hist < 1 || hist > 20) {
+		printf("hist of 2level must be 1..20. Dying\n");
+		exit(-1);
+	}
+	return new PAP_PREDICTOR(params.GetPow2("bht", 512), hist, params.GetPow2("pht", 8));
+}
+
+REGISTER_PREDICTOR(reg2level, "2level", Create2level,
+	"PAp with private histories [bht=512:hist=6:pht=8]");
+
 /////////////////////////////////////////////////////////////
 // openend
 /////////////////////////////////////////////////////////////
@@ -144,462 +277,24 @@ Global History Register is 512 bits:					512			= 512
 Each table has two CSRs, one 11 bits and one 10 bits:	7*(21)		= 147
 --------------------------------------------------------------------------------------------
 														Total		= 129691 bits < 128Kbits
-*/
-
 
-// Macro definitions
-#define NUM_TOTAL_TABLES 8
-#define NUM_TAGE_TABLES 7
-#define NUM_TAGE_COLUMNS 3
-#define NUM_TAGE_ENTRIES 1024
-#define NUM_PRED_MODES 8
-#define NUM_GHR_BITS 512
-
-#define TAG_WIDTH 11
-#define T1_HIS_BITS 8
-#define T2_HIS_BITS 16
-#define T3_HIS_BITS 32
-#define T4_HIS_BITS 64
-#define T5_HIS_BITS 128
-#define T6_HIS_BITS 256
-#define T7_HIS_BITS 512
-
-#define T0_PHRT_ENTRIES 1024
-#define T0_PHT_TABLES 8
-#define T0_PHT_ENTRIES 512
-#define T0_PHT_MODES 8
-#define T0_PHT_PC_BITS 3
-
-// Global variables declarations
-int T0Phrt[T0_PHRT_ENTRIES];
-int T0Pht[T0_PHT_TABLES][T0_PHT_ENTRIES];
-
-int GHR[NUM_GHR_BITS];
-
-int T1[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-int T2[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-int T3[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-int T4[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-int T5[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-int T6[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-int T7[NUM_TAGE_ENTRIES][NUM_TAGE_COLUMNS];
-
-int providerComp;
-int providerPred;
-int providerIndex;
-int altPred;
-int probability;
-int useCounter;
-
-int CSR[NUM_TAGE_TABLES][2][TAG_WIDTH];
-
-// Functions used by PaP
-// START T0 //////////////////////////////////////////////////////////
-void initT0 () {
-	int i, j;
-	for(i = 0; i < T0_PHRT_ENTRIES; i++)
-		T0Phrt[i] = 0;
-	for(i = 0; i < T0_PHT_TABLES; i++)
-		for(j = 0; j < T0_PHT_ENTRIES; j++)
-			T0Pht[i][j] = (T0_PHT_MODES/2)-1;
-}
-
-unsigned getT0 (UINT32 PC) {
-	unsigned phrtIndex = (PC >> T0_PHT_PC_BITS) & (T0_PHRT_ENTRIES-1);
-	unsigned phtIndex = PC & (T0_PHT_TABLES-1);
-	unsigned mode = T0Pht[phtIndex][T0Phrt[phrtIndex]];
-	if (mode <= ((T0_PHT_MODES/2)-1)) return NOT_TAKEN;
-	else return TAKEN;
-}
-
-void updateT0 (UINT32 PC, bool resolveDir) {
-	unsigned phrtIndex = (PC >> T0_PHT_PC_BITS) & (T0_PHRT_ENTRIES-1);
-	unsigned phtIndex = PC & (T0_PHT_TABLES-1);
-	if ((resolveDir == NOT_TAKEN) && (T0Pht[phtIndex][T0Phrt[phrtIndex]] != 0)) T0Pht[phtIndex][T0Phrt[phrtIndex]]--;
-	if ((resolveDir == TAKEN) && (T0Pht[phtIndex][T0Phrt[phrtIndex]] != (T0_PHT_MODES-1))) T0Pht[phtIndex][T0Phrt[phrtIndex]]++;
-	T0Phrt[phrtIndex] = ((T0Phrt[phrtIndex] << 1) & (T0_PHT_ENTRIES-1)) | (unsigned)resolveDir;
-}
-// END T0 ////////////////////////////////////////////////////////////
-
-// Functions used for updating and obtaining the CSR entries
-// START CSR //////////////////////////////////////////////////////////
-void updateCSR (int table, int numHisBits) {
-	int CSR0MSB = CSR[table][0][TAG_WIDTH-1];
-	int CSR1MSB = CSR[table][1][TAG_WIDTH-2];
-
-	int i;
-	for (i = TAG_WIDTH - 1; i > 0; i--) {
-		CSR[table][0][i] = CSR[table][0][i-1];
-		if (i < (TAG_WIDTH - 1))
-			CSR[table][1][i] = CSR[table][1][i-1];
-	}
-
-    CSR[table][0][0] = GHR[0] ^ CSR0MSB;
-    CSR[table][0][numHisBits%TAG_WIDTH] = GHR[numHisBits] ^ CSR[table][0][numHisBits%TAG_WIDTH];
-
-    CSR[table][1][0] = GHR[0] ^ CSR1MSB;
-    CSR[table][1][numHisBits%(TAG_WIDTH-1)] = GHR[numHisBits] ^ CSR[table][1][numHisBits%(TAG_WIDTH-1)];
-}
-
-int getCSR (int table, int num) {
-	int i;
-	int end = num?TAG_WIDTH:(TAG_WIDTH-1);
-	unsigned int pow = 1;
-	unsigned int sum = 0;
-	for (i = 0; i < end; i++) {
-		sum += pow * CSR[table][num][i];	
-		pow *= 10;
-	}
-	return sum;
-}
-// END CSR ////////////////////////////////////////////////////////////
-
-void InitPredictor_openend() {
-
-	int i, j;
-
-	// Initialize T0 PaP
-	initT0();
-
-	// Initialize the GHR and CSRs
-	for (i = 0; i < NUM_GHR_BITS; i++) {
-		GHR[i] = 0;
-	}
-	for (i = 0; i < NUM_TAGE_TABLES; i++) {
-		for (j = 0; j < TAG_WIDTH; j++) {
-			CSR[i][0][j] = 0;
-			CSR[i][1][j] = 0;
-		}
-	}
-	
-	// Initialize tables T0-T7
-	for (i = 0; i < NUM_TAGE_ENTRIES; i++) {
-		T1[i][0] = (NUM_PRED_MODES/2)-1;
-		T1[i][1] = 0;
-		T1[i][2] = 0;
-		T2[i][0] = (NUM_PRED_MODES/2)-1;
-		T2[i][1] = 0;
-		T2[i][2] = 0;
-		T3[i][0] = (NUM_PRED_MODES/2)-1;
-		T3[i][1] = 0;
-		T3[i][2] = 0;
-		T4[i][0] = (NUM_PRED_MODES/2)-1;
-		T4[i][1] = 0;
-		T4[i][2] = 0;
-		T5[i][0] = (NUM_PRED_MODES/2)-1;
-		T5[i][1] = 0;
-		T5[i][2] = 0;
-		T6[i][0] = (NUM_PRED_MODES/2)-1;
-		T6[i][1] = 0;
-		T6[i][2] = 0;
-		T7[i][0] = (NUM_PRED_MODES/2)-1;
-		T7[i][1] = 0;
-		T7[i][2] = 0;
-	}
-
-	// Initialize other global variables
-	providerComp = NULL;
-	providerPred = NULL;
-	providerIndex = NULL;
-	altPred = NULL;
-	probability = 0;
-	useCounter = 128;
-}
-
-bool GetPrediction_openend(UINT32 PC) {
-
-	int i, j;
-
-	// Set T0 as the default predictor component
-	providerComp = 0;
-	providerPred = getT0(PC);
-	providerIndex = -1;
-	altPred = getT0(PC);
-
-	int pred[NUM_TOTAL_TABLES] = {providerPred, -1, -1, -1, -1, -1, -1, -1};
-	int index[NUM_TOTAL_TABLES] = {NULL, -1, -1, -1, -1, -1, -1, -1};
-	int useful[NUM_TOTAL_TABLES] = {NULL, 0, 0, 0, 0, 0, 0, 0};
-
-	// Calculate tags
-	unsigned int tagT1, tagT2, tagT3, tagT4, tagT5, tagT6, tagT7;
-	tagT1 = (PC ^ getCSR(0,0) ^ (getCSR(0,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	tagT2 = (PC ^ getCSR(1,0) ^ (getCSR(1,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	tagT3 = (PC ^ getCSR(2,0) ^ (getCSR(2,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	tagT4 = (PC ^ getCSR(3,0) ^ (getCSR(3,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	tagT5 = (PC ^ getCSR(4,0) ^ (getCSR(4,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	tagT6 = (PC ^ getCSR(5,0) ^ (getCSR(5,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	tagT7 = (PC ^ getCSR(6,0) ^ (getCSR(6,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-	
-	// Calculate indices
-	unsigned int indT1, indT2, indT3, indT4, indT5, indT6, indT7;
-	indT1 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(0,1)) & (NUM_TAGE_ENTRIES-1);
-	indT2 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(1,1)) & (NUM_TAGE_ENTRIES-1);
-	indT3 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(2,1)) & (NUM_TAGE_ENTRIES-1);
-	indT4 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(3,1)) & (NUM_TAGE_ENTRIES-1);
-	indT5 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(4,1)) & (NUM_TAGE_ENTRIES-1);
-	indT6 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(5,1)) & (NUM_TAGE_ENTRIES-1);
-	indT7 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(6,1)) & (NUM_TAGE_ENTRIES-1);
-
-	// Check if the entry exists in any of the tables
-	if (T1[indT1][1] == tagT1) {
-		pred[1] = T1[indT1][0];
-		index[1] = indT1;
-		useful[1] = T1[indT1][2];
-	}
-	if (T2[indT2][1] == tagT2) {
-		pred[2] = T2[indT2][0];
-		index[2] = indT2;
-		useful[2] = T2[indT2][2];
-	}
-	if (T3[indT3][1] == tagT3) {
-		pred[3] = T3[indT3][0];
-		index[3] = indT3;
-		useful[3] = T3[indT3][2];
-	}
-	if (T4[indT4][1] == tagT4) {
-		pred[4] = T4[indT4][0];
-		index[4] = indT4;
-		useful[4] = T4[indT4][2];
-	}
-	if (T5[indT5][1] == tagT5) {
-		pred[5] = T5[indT5][0];
-		index[5] = indT5;
-		useful[5] = T5[indT5][2];
-	}
-	if (T6[indT6][1] == tagT6) {
-		pred[6] = T6[indT6][0];
-		index[6] = indT6;
-		useful[6] = T6[indT6][2];
-	}
-	if (T7[indT7][1] == tagT7) {
-		pred[7] = T7[indT7][0];
-		index[7] = indT7;
-		useful[7] = T7[indT7][2];
-	}
-
-	// Provide prediction from the highest component. If weak, provide altPred.
-	bool weak = false;
-	for(i = NUM_TAGE_TABLES; i > 0; i--) {
-		if (pred[i] != -1) {
-			providerComp = i;
-			providerPred = (pred[i]<(NUM_PRED_MODES/2))?NOT_TAKEN:TAKEN;
-			providerIndex = index[i];
-			if (((pred[i] > 2) && (pred[i] < 5)) || (useful[i] == 0)) weak = true;
-			for(j = i - 1; j > 0; j--) {
-				if (pred[j] != -1) {
-					altPred = (pred[i]<(NUM_PRED_MODES/2))?NOT_TAKEN:TAKEN;
-					break;
-				}
-			}
-			break;
-		}
-	}
-
-	return weak?altPred:providerPred;
-}
-
-void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
-	
-	int i;
-
-	// Update T0 PaP
-	updateT0(PC, resolveDir);
-
-	int useful = 0, pred = 0;
-	if (providerComp != 0) {
-		// Always update prediction bits for the provider component
-		if (resolveDir == TAKEN) {
-			if ((providerComp == 1) && (T1[providerIndex][0] != 7)) { T1[providerIndex][0]++; useful = T1[providerIndex][2]; pred = T1[providerIndex][0]; }
-			if ((providerComp == 2) && (T2[providerIndex][0] != 7)) { T2[providerIndex][0]++; useful = T2[providerIndex][2]; pred = T2[providerIndex][0]; }
-			if ((providerComp == 3) && (T3[providerIndex][0] != 7)) { T3[providerIndex][0]++; useful = T3[providerIndex][2]; pred = T3[providerIndex][0]; }
-			if ((providerComp == 4) && (T4[providerIndex][0] != 7)) { T4[providerIndex][0]++; useful = T4[providerIndex][2]; pred = T4[providerIndex][0]; }
-			if ((providerComp == 5) && (T5[providerIndex][0] != 7)) { T5[providerIndex][0]++; useful = T5[providerIndex][2]; pred = T5[providerIndex][0]; }
-			if ((providerComp == 6) && (T6[providerIndex][0] != 7)) { T6[providerIndex][0]++; useful = T6[providerIndex][2]; pred = T6[providerIndex][0]; }
-			if ((providerComp == 7) && (T7[providerIndex][0] != 7)) { T7[providerIndex][0]++; useful = T7[providerIndex][2]; pred = T7[providerIndex][0]; }
-		} else {
-			if ((providerComp == 1) && (T1[providerIndex][0] != 0)) { T1[providerIndex][0]--; useful = T1[providerIndex][2]; pred = T1[providerIndex][0]; }
-			if ((providerComp == 2) && (T2[providerIndex][0] != 0)) { T2[providerIndex][0]--; useful = T2[providerIndex][2]; pred = T2[providerIndex][0]; }
-			if ((providerComp == 3) && (T3[providerIndex][0] != 0)) { T3[providerIndex][0]--; useful = T3[providerIndex][2]; pred = T3[providerIndex][0]; }
-			if ((providerComp == 4) && (T4[providerIndex][0] != 0)) { T4[providerIndex][0]--; useful = T4[providerIndex][2]; pred = T4[providerIndex][0]; }
-			if ((providerComp == 5) && (T5[providerIndex][0] != 0)) { T5[providerIndex][0]--; useful = T5[providerIndex][2]; pred = T5[providerIndex][0]; }
-			if ((providerComp == 6) && (T6[providerIndex][0] != 0)) { T6[providerIndex][0]--; useful = T6[providerIndex][2]; pred = T6[providerIndex][0]; }
-			if ((providerComp == 7) && (T7[providerIndex][0] != 0)) { T7[providerIndex][0]--; useful = T7[providerIndex][2]; pred = T7[providerIndex][0]; }
-		}
+./predictor -budget -pred openend derives this from the configuration (see Storage in
+tage.h); it also counts the 2-bit allocation toggle, for 129693 bits.
+*/
 
-		// Update useful bit according to the method describes in [2]
-		if ((providerPred == resolveDir) && (providerPred != altPred)) {
-			if (providerComp == 1) T1[providerIndex][2]= 1;
-			if (providerComp == 2) T2[providerIndex][2]= 1;
-			if (providerComp == 3) T3[providerIndex][2]= 1;
-			if (providerComp == 4) T4[providerIndex][2]= 1;
-			if (providerComp == 5) T5[providerIndex][2]= 1;
-			if (providerComp == 6) T6[providerIndex][2]= 1;
-			if (providerComp == 7) T7[providerIndex][2]= 1;
-			if (useCounter != 255) useCounter++;
-		} else if ((providerPred != resolveDir) && (providerPred != altPred)) {
-			if (providerComp == 1) T1[providerIndex][2]= 0;
-			if (providerComp == 2) T2[providerIndex][2]= 0;
-			if (providerComp == 3) T3[providerIndex][2]= 0;
-			if (providerComp == 4) T4[providerIndex][2]= 0;
-			if (providerComp == 5) T5[providerIndex][2]= 0;
-			if (providerComp == 6) T6[providerIndex][2]= 0;
-			if (providerComp == 7) T7[providerIndex][2]= 0;
-			if (useCounter != 0) useCounter--;
-		}
-	}
-	
-	if ((providerComp != NUM_TAGE_TABLES) && ((resolveDir != providerPred) && !((useful == 0) && (pred > 2) && (pred < 5)))) {
-
-		int initialPred = resolveDir?4:3;
-		bool found[NUM_TAGE_TABLES] = {false, false, false, false, false, false, false};
-
-		// Calculate tags
-		unsigned int tagT1, tagT2, tagT3, tagT4, tagT5, tagT6, tagT7;
-		tagT1 = (PC ^ getCSR(0,0) ^ (getCSR(0,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-		tagT2 = (PC ^ getCSR(1,0) ^ (getCSR(1,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-		tagT3 = (PC ^ getCSR(2,0) ^ (getCSR(2,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-		tagT4 = (PC ^ getCSR(3,0) ^ (getCSR(3,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-		tagT5 = (PC ^ getCSR(4,0) ^ (getCSR(4,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-		tagT6 = (PC ^ getCSR(5,0) ^ (getCSR(5,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-		tagT7 = (PC ^ getCSR(6,0) ^ (getCSR(6,1) << 1)) & (NUM_TAGE_ENTRIES-1);
-
-		// Calculate indices
-		unsigned int indT1, indT2, indT3, indT4, indT5, indT6, indT7;
-		indT1 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(0,1)) & (NUM_TAGE_ENTRIES-1);
-		indT2 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(1,1)) & (NUM_TAGE_ENTRIES-1);
-		indT3 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(2,1)) & (NUM_TAGE_ENTRIES-1);
-		indT4 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(3,1)) & (NUM_TAGE_ENTRIES-1);
-		indT5 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(4,1)) & (NUM_TAGE_ENTRIES-1);
-		indT6 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(5,1)) & (NUM_TAGE_ENTRIES-1);
-		indT7 = (PC ^ (PC >> TAG_WIDTH) ^ getCSR(6,1)) & (NUM_TAGE_ENTRIES-1);
-
-		// Check how many available entries are found
-		int numFound = 0;
-		if ((providerComp <= 0) && (T1[indT1][2] == 0)) { found[0] = true; numFound++; }
-		if ((providerComp <= 1) && (T2[indT2][2] == 0)) { found[1] = true; numFound++; }
-		if ((providerComp <= 2) && (T3[indT3][2] == 0) && (numFound < 2)) { found[2] = true; numFound++; }
-		if ((providerComp <= 3) && (T4[indT4][2] == 0) && (numFound < 2)) { found[3] = true; numFound++; }
-		if ((providerComp <= 4) && (T5[indT5][2] == 0) && (numFound < 2)) { found[4] = true; numFound++; }
-		if ((providerComp <= 5) && (T6[indT6][2] == 0) && (numFound < 2)) { found[5] = true; numFound++; }
-		if ((providerComp <= 6) && (T7[indT7][2] == 0) && (numFound < 2)) { found[6] = true; numFound++; }
-
-		// If an empty entry is not found, reset all the useful bits
-		// If only one entry is found, allocate it
-		// If multiple entries are found, use 1/2 probability to allocate a higher table
-		// and 1/2 probability to occupy the lower-numbered table as suggested it gives better results.
-		if (numFound == 0) {
-			if (providerComp <= 0)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T1[i][2] = 0;
-			if (providerComp <= 1)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T2[i][2] = 0;
-			if (providerComp <= 2)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T3[i][2] = 0;
-			if (providerComp <= 3)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T4[i][2] = 0;
-			if (providerComp <= 4)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T5[i][2] = 0;
-			if (providerComp <= 5)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T6[i][2] = 0;
-			if (providerComp <= 6)
-				for (i = 0; i < NUM_TAGE_ENTRIES; i++)
-					T7[i][2] = 0;
-		} else if ((numFound == 1) || ((numFound > 1) && (probability < 2))) {
-			if (found[0] == true) {
-				T1[indT1][0] = initialPred;
-				T1[indT1][1] = tagT1;
-				T1[indT1][2] = 0;
-			} else if (found[1] == true) {
-				T2[indT2][0] = initialPred;
-				T2[indT2][1] = tagT2;
-				T2[indT2][2] = 0;
-			} else if (found[2] == true) {
-				T3[indT3][0] = initialPred;
-				T3[indT3][1] = tagT3;
-				T3[indT3][2] = 0;
-			} else if (found[3] == true) {
-				T4[indT4][0] = initialPred;
-				T4[indT4][1] = tagT4;
-				T4[indT4][2] = 0;
-			} else if (found[4] == true) {
-				T5[indT5][0] = initialPred;
-				T5[indT5][1] = tagT5;
-				T5[indT5][2] = 0;
-			} else if (found[5] == true) {
-				T6[indT6][0] = initialPred;
-				T6[indT6][1] = tagT6;
-				T6[indT6][2] = 0;
-			} else if (found[6] == true) {
-				T7[indT7][0] = initialPred;
-				T7[indT7][1] = tagT7;
-				T7[indT7][2] = 0;
-			}
-			probability++;
-		} else if ((numFound > 1) && (probability >= 2)) {
-			probability = 1;
-			if (found[6] == true) {
-				T7[indT7][0] = initialPred;
-				T7[indT7][1] = tagT7;
-				T7[indT7][2] = 0;
-			} else if (found[5] == true) {
-				T6[indT6][0] = initialPred;
-				T6[indT6][1] = tagT6;
-				T6[indT6][2] = 0;
-			} else if (found[4] == true) {
-				T5[indT5][0] = initialPred;
-				T5[indT5][1] = tagT5;
-				T5[indT5][2] = 0;
-			} else if (found[3] == true) {
-				T4[indT4][0] = initialPred;
-				T4[indT4][1] = tagT4;
-				T4[indT4][2] = 0;
-			} else if (found[2] == true) {
-				T3[indT3][0] = initialPred;
-				T3[indT3][1] = tagT3;
-				T3[indT3][2] = 0;
-			} else if (found[1] == true) {
-				T2[indT2][0] = initialPred;
-				T2[indT2][1] = tagT2;
-				T2[indT2][2] = 0;
-			} else if (found[0] == true) {
-				T1[indT1][0] = initialPred;
-				T1[indT1][1] = tagT1;
-				T1[indT1][2] = 0;
-			} 
-		}
-	}
 
-	// Reset all the useful bits when the useful counter is sturated
-	if (useCounter == 0) {
-		for (i = 0; i < NUM_TAGE_ENTRIES; i++) {
-			T1[i][2] = 0;
-			T2[i][2] = 0;
-			T3[i][2] = 0;
-			T4[i][2] = 0;
-			T5[i][2] = 0;
-			T6[i][2] = 0;
-			T7[i][2] = 0;
-		}
-		useCounter = 128;
-	}
+// 7 tagged tables of 1024 entries with 11-bit tags and geometric
+// histories over the 1024-entry PAp in T0; see tage.h
+typedef TAGE_PREDICTOR<10, 11, 8, 16, 32, 64, 128, 256, 512> OPENEND_PREDICTOR;
 
-	// Update the GHR and the CSRs for each table
-	for (i = NUM_GHR_BITS - 1; i > 0; i--) {
-		GHR[i] = GHR[i-1];
+static BRANCH_PREDICTOR *CreateOpenend(PREDICTOR_PARAMS &params) {
+	string fold = params.GetString("fold", "binary");
+	if (fold != "binary" && fold != "compat") {
+		printf("fold of openend must be binary or compat. Dying\n");
+		exit(-1);
 	}
-	GHR[0] = resolveDir;
-
-	updateCSR(0, T1_HIS_BITS-1);
-	updateCSR(1, T2_HIS_BITS-1);
-	updateCSR(2, T3_HIS_BITS-1);
-	updateCSR(3, T4_HIS_BITS-1);
-	updateCSR(4, T5_HIS_BITS-1);
-	updateCSR(5, T6_HIS_BITS-1);
-	updateCSR(6, T7_HIS_BITS-1);
+	return new OPENEND_PREDICTOR(fold == "compat");
 }
 
+REGISTER_PREDICTOR(regOpenend, "openend", CreateOpenend,
+	"8-component TAGE over a PAp base, 128 Kbit [fold=binary|compat]");
@@ -1,28 +1,169 @@
 #ifndef _PREDICTOR_H_
 #define _PREDICTOR_H_
 
+#include <map>
+#include <set>
+#include <vector>
+#include <string.h>
 #include "utils.h"
 #include "tracer.h"
+#include "budget.h"
 
 /////////////////////////////////////////////////////////////
+// Serialized predictor state for snapshots
+/////////////////////////////////////////////////////////////
+
+// A predictor lists its state once, in Checkpoint; while saving each
+// field is appended to the buffer and while loading it is read back in
+// the same order. A short or mismatched buffer clears Ok().
+class PREDICTOR_STATE{
+ private:
+  vector<char> *buf;
+  size_t pos;
+  bool   loading;
+  bool   ok;
+
+ public:
+  PREDICTOR_STATE(vector<char> *buffer, bool load){
+    buf = buffer;
+    pos = 0;
+    loading = load;
+    ok = true;
+  }
+
+  void Bytes(void *data, size_t len){
+    if (!ok) return;
+    if (loading) {
+      if (pos + len > buf->size()) { ok = false; return; }
+      memcpy(data, &(*buf)[pos], len);
+      pos += len;
+    } else {
+      buf->insert(buf->end(), (char *)data, (char *)data + len);
+    }
+  }
 
-void InitPredictor_2bitsat();
-bool GetPrediction_2bitsat(UINT32 PC);  
-void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  template <class T> void Field(T &value){ Bytes(&value, sizeof(T)); }
+  template <class T> void Array(T *values, size_t n){ Bytes(values, n * sizeof(T)); }
 
+  // Loading must consume the buffer exactly
+  bool Ok(){ return ok && (!loading || pos == buf->size()); }
+};
+
+/////////////////////////////////////////////////////////////
+// Interface every direction predictor implements
 /////////////////////////////////////////////////////////////
 
-void InitPredictor_2level();
-bool GetPrediction_2level(UINT32 PC);  
-void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+class BRANCH_PREDICTOR{
+ public:
+  string name;   // spec the instance was created from, e.g. "2bitsat:entries=8192"
+
+  virtual ~BRANCH_PREDICTOR(){}
+
+  virtual void Init() = 0;
+  virtual bool GetPrediction(UINT32 PC) = 0;
+  virtual void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) = 0;
+
+  // Tables, histories and counters; everything Init would reset
+  virtual void Checkpoint(PREDICTOR_STATE &state) = 0;
+
+  // The same state in hardware bits, with the order of its reads
+  virtual void Storage(STORAGE_BUDGET &budget) = 0;
+
+  const char *GetName(){ return name.c_str(); }
+};
 
 /////////////////////////////////////////////////////////////
+// Key/value parameters parsed from "family:key=value:key=value"
+/////////////////////////////////////////////////////////////
+
+class PREDICTOR_PARAMS{
+ private:
+  map<string, string> values;
+  set<string> used;
+
+ public:
+  string family;
 
-void InitPredictor_openend();
-bool GetPrediction_openend(UINT32 PC);  
-void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  bool        Parse(const char *spec);
+  bool        Has(const char *key);
+  UINT32      GetUInt(const char *key, UINT32 def);
+  UINT32      GetPow2(const char *key, UINT32 def);
+  string      GetString(const char *key, const char *def);
+  void        CheckUnused();
+};
 
+/////////////////////////////////////////////////////////////
+// Name-to-factory registry of predictor families
 /////////////////////////////////////////////////////////////
 
-#endif
+// One registry per predictor interface (BRANCH_PREDICTOR, and
+// TARGET_PREDICTOR in target.h), each with its own families
+template <class PREDICTOR>
+class REGISTRY{
+ public:
+  typedef PREDICTOR *(*FACTORY)(PREDICTOR_PARAMS &params);
+
+ private:
+  class FAMILY{
+    public:
+    FACTORY factory;
+    string help;
+  };
+
+  // Function-local so registration from other files' static initializers
+  // never runs before the map is constructed
+  static map<string, FAMILY> &Families(){
+    static map<string, FAMILY> families;
+    return families;
+  }
+
+ public:
+  static void Register(const char *family, FACTORY factory, const char *help){
+    FAMILY f;
+    f.factory = factory;
+    f.help = help;
+    Families()[family] = f;
+  }
+
+  static PREDICTOR *Create(const char *spec){
+    PREDICTOR_PARAMS params;
+    if (!params.Parse(spec)) {
+      printf("Malformed predictor spec %s. Dying\n", spec);
+      exit(-1);
+    }
+    typename map<string, FAMILY>::iterator it = Families().find(params.family);
+    if (it == Families().end()) {
+      printf("Unknown predictor %s. Dying\n", params.family.c_str());
+      exit(-1);
+    }
+    PREDICTOR *pred = it->second.factory(params);
+    params.CheckUnused();
+    pred->name = spec;
+    return pred;
+  }
+
+  static void List(FILE *out){
+    typename map<string, FAMILY>::iterator it;
+    for (it = Families().begin(); it != Families().end(); it++)
+      fprintf(out, "  %-10s %s\n", it->first.c_str(), it->second.help.c_str());
+  }
+};
 
+// Registers a family at static-initialization time from any .cc file
+template <class PREDICTOR>
+class REGISTRAR{
+ public:
+  REGISTRAR(const char *family, typename REGISTRY<PREDICTOR>::FACTORY factory, const char *help){
+    REGISTRY<PREDICTOR>::Register(family, factory, help);
+  }
+};
+
+typedef REGISTRY<BRANCH_PREDICTOR>::FACTORY PREDICTOR_FACTORY;
+typedef REGISTRY<BRANCH_PREDICTOR> PREDICTOR_REGISTRY;
+
+#define REGISTER_PREDICTOR(var, family, factory, help) \
+  static REGISTRAR<BRANCH_PREDICTOR> var(family, factory, help)
+
+/////////////////////////////////////////////////////////////
+
+#endif
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include "profiler.h"
+#include "harness.h"
+
+/////////////////////////////////////////////////////////////
+// Per-branch misprediction profile
+/////////////////////////////////////////////////////////////
+
+BRANCH_PROFILER::BRANCH_PROFILER(int numPred){
+  for (int p = 0; p < numPred; p++) {
+    misses.push_back(new PC_MAP<PC_MISSES>());
+  }
+}
+
+BRANCH_PROFILER::~BRANCH_PROFILER(){
+  for (size_t p = 0; p < misses.size(); p++) {
+    delete misses[p];
+  }
+}
+
+void BRANCH_PROFILER::Clear(){
+  branches.Clear();
+  for (size_t p = 0; p < misses.size(); p++) {
+    misses[p]->Clear();
+  }
+}
+
+/////////////////////////////////////////////////////////////
+
+class PC_OFFENDER{
+  public:
+  UINT32 PC;
+  UINT64 numMispred;
+  UINT64 numExec;
+  UINT64 numTaken;
+};
+
+static bool MoreMispred(const PC_OFFENDER &a, const PC_OFFENDER &b){
+  if (a.numMispred != b.numMispred) return a.numMispred > b.numMispred;
+  return a.PC < b.PC;
+}
+
+static double Percent(UINT64 part, UINT64 whole){
+  return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+// 1, 2, 5, 10, 20, 50, 100, ...
+static size_t CurvePoint(int step){
+  size_t k = (step % 3 == 0) ? 1 : (step % 3 == 1) ? 2 : 5;
+  for (int d = 0; d < step / 3; d++) k *= 10;
+  return k;
+}
+
+// Taken bias below 5% or above 95% counts as strongly biased
+#define PROFILE_BIAS_PERCENT 5.0
+
+void BRANCH_PROFILER::Report(FILE *out, int topN){
+  for (size_t p = 0; p < misses.size(); p++) {
+    vector<PC_OFFENDER> offenders;
+    UINT64 total = 0;
+    UINT64 byBias[3] = {0, 0, 0};   // mostly not-taken, mixed, mostly taken
+
+    for (UINT32 i = 0; i < misses[p]->Capacity(); i++) {
+      const PC_MISSES &m = misses[p]->Slot(i);
+      if (m.count == 0) continue;
+      const PC_BRANCH *b = branches.Find(m.PC);
+      PC_OFFENDER o;
+      o.PC = m.PC;
+      o.numMispred = m.count;
+      o.numExec = b ? b->count : 0;
+      o.numTaken = b ? b->numTaken : 0;
+      offenders.push_back(o);
+      total += m.count;
+
+      double taken = Percent(o.numTaken, o.numExec);
+      if (taken < PROFILE_BIAS_PERCENT) byBias[0] += m.count;
+      else if (taken > 100.0 - PROFILE_BIAS_PERCENT) byBias[2] += m.count;
+      else byBias[1] += m.count;
+    }
+    sort(offenders.begin(), offenders.end(), MoreMispred);
+
+    fprintf(out, "\nPROFILE %s: %llu mispredictions from %zu of %u static branches\n",
+            PredictorName(p), total, offenders.size(), branches.Size());
+
+    // Top-N offenders
+    fprintf(out, "\n  %4s  %10s  %10s  %6s  %10s  %6s  %6s  %6s\n",
+            "rank", "PC", "execs", "taken%", "mispred", "rate%", "share%", "cum%");
+    UINT64 cum = 0;
+    for (size_t i = 0; i < offenders.size() && (int)i < topN; i++) {
+      const PC_OFFENDER &o = offenders[i];
+      cum += o.numMispred;
+      fprintf(out, "  %4zu  0x%08x  %10llu  %6.1f  %10llu  %6.1f  %6.1f  %6.1f\n",
+              i + 1, o.PC, o.numExec, Percent(o.numTaken, o.numExec), o.numMispred,
+              Percent(o.numMispred, o.numExec), Percent(o.numMispred, total), Percent(cum, total));
+    }
+
+    // Cumulative-miss curve at 1, 2, 5, 10, 20, 50, ... static branches
+    fprintf(out, "\n  cumulative mispredictions of the worst K static branches:\n");
+    cum = 0;
+    int step = 0;
+    for (size_t i = 0; i < offenders.size(); i++) {
+      cum += offenders[i].numMispred;
+      if (i + 1 == CurvePoint(step) || i + 1 == offenders.size()) {
+        fprintf(out, "    K = %-8zu %6.1f%%\n", i + 1, Percent(cum, total));
+        step++;
+      }
+    }
+
+    // Static branches needed to cover a share of the misses
+    const double covers[] = {50.0, 90.0, 99.0};
+    fprintf(out, "  static branches for");
+    cum = 0;
+    size_t i = 0;
+    for (int c = 0; c < 3; c++) {
+      while (i < offenders.size() && Percent(cum, total) < covers[c]) cum += offenders[i++].numMispred;
+      fprintf(out, "%s %.0f%%: %zu", c ? "," : "", covers[c], i);
+    }
+    fprintf(out, "\n");
+
+    fprintf(out, "  mispredictions by taken bias: <%.0f%%: %.1f%%, mixed: %.1f%%, >%.0f%%: %.1f%%\n",
+            PROFILE_BIAS_PERCENT, Percent(byBias[0], total), Percent(byBias[1], total),
+            100.0 - PROFILE_BIAS_PERCENT, Percent(byBias[2], total));
+  }
+}
+
+/////////////////////////////////////////////////////////////
+
+bool BRANCH_PROFILER::WriteCsv(const char *fileName){
+  FILE *out = fopen(fileName, "w");
+  if (out == NULL) return false;
+
+  vector<PC_BRANCH> rows;
+  for (UINT32 i = 0; i < branches.Capacity(); i++) {
+    if (branches.Slot(i).count != 0) rows.push_back(branches.Slot(i));
+  }
+  sort(rows.begin(), rows.end(),
+       [](const PC_BRANCH &a, const PC_BRANCH &b) { return a.PC < b.PC; });
+
+  fprintf(out, "pc,executions,taken,taken_bias");
+  for (size_t p = 0; p < misses.size(); p++) {
+    fprintf(out, ",%s_mispredictions", PredictorName(p));
+  }
+  fprintf(out, "\n");
+
+  for (size_t r = 0; r < rows.size(); r++) {
+    fprintf(out, "0x%08x,%llu,%llu,%.4f", rows[r].PC, rows[r].count, rows[r].numTaken,
+            (double)rows[r].numTaken / (double)rows[r].count);
+    for (size_t p = 0; p < misses.size(); p++) {
+      const PC_MISSES *m = misses[p]->Find(rows[r].PC);
+      fprintf(out, ",%llu", m ? m->count : 0ULL);
+    }
+    fprintf(out, "\n");
+  }
+
+  fclose(out);
+  return true;
+}
@@ -0,0 +1,159 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+
+/////////////////////////////////////////////////////////////
+// Compact PC-keyed hash map
+/////////////////////////////////////////////////////////////
+
+/*
+	Open addressing with linear probing over a power-of-two table that
+	doubles at half load. ENTRY must have a UINT32 PC and a UINT64 count;
+	a slot is in use once its count is non-zero, so Insert's caller must
+	bump count before the next Insert. No per-entry allocation, no
+	pointers: a trace with a few thousand static branches fits in a few
+	pages.
+*/
+
+template <class ENTRY>
+class PC_MAP{
+ private:
+  ENTRY  *table;
+  UINT32  capacity;
+  UINT32  size;
+  int     shift;     // 32 - log2(capacity)
+
+  // Fibonacci hashing: the top bits of PC * 2^32/phi
+  UINT32 Hash(UINT32 PC) const {
+    return (PC * 0x9E3779B1u) >> shift;
+  }
+
+  UINT32 Probe(UINT32 PC){
+    UINT32 h = Hash(PC);
+    while (table[h].count != 0 && table[h].PC != PC) {
+      h = (h + 1) & (capacity - 1);
+    }
+    return h;
+  }
+
+  void Grow(){
+    ENTRY *old = table;
+    UINT32 oldCapacity = capacity;
+    capacity *= 2;
+    shift--;
+    table = new ENTRY[capacity]();
+    for (UINT32 i = 0; i < oldCapacity; i++) {
+      if (old[i].count != 0) table[Probe(old[i].PC)] = old[i];
+    }
+    delete [] old;
+  }
+
+ public:
+  PC_MAP(){
+    capacity = 1024;
+    shift = 22;
+    size = 0;
+    table = new ENTRY[capacity]();
+  }
+
+  ~PC_MAP(){
+    delete [] table;
+  }
+
+  void Clear(){
+    for (UINT32 i = 0; i < capacity; i++) table[i] = ENTRY();
+    size = 0;
+  }
+
+  // Entry for PC, created with a zero count if it is not there yet
+  ENTRY *Insert(UINT32 PC){
+    UINT32 h = Probe(PC);
+    if (table[h].count == 0) {
+      if (2 * (size + 1) > capacity) {
+        Grow();
+        h = Probe(PC);
+      }
+      table[h].PC = PC;
+      size++;
+    }
+    return &table[h];
+  }
+
+  // Entry for PC, or NULL
+  const ENTRY *Find(UINT32 PC) const {
+    UINT32 h = Hash(PC);
+    while (table[h].count != 0) {
+      if (table[h].PC == PC) return &table[h];
+      h = (h + 1) & (capacity - 1);
+    }
+    return NULL;
+  }
+
+  UINT32 Size() const { return size; }
+  UINT32 Capacity() const { return capacity; }
+  const ENTRY &Slot(UINT32 i) const { return table[i]; }
+};
+
+/////////////////////////////////////////////////////////////
+// Per-branch misprediction profile
+/////////////////////////////////////////////////////////////
+
+class PC_BRANCH{
+  public:
+  UINT32 PC;
+  UINT64 count;      // executions
+  UINT64 numTaken;
+
+  PC_BRANCH(){ PC=0; count=0; numTaken=0; }
+};
+
+class PC_MISSES{
+  public:
+  UINT32 PC;
+  UINT64 count;      // mispredictions
+
+  PC_MISSES(){ PC=0; count=0; }
+};
+
+/*
+	Executions and taken counts are gathered once per branch by the thread
+	that decodes the trace; mispredictions go to one map per predictor,
+	touched only by whichever thread runs that predictor and only on a
+	miss. Profiling therefore costs one hash lookup per conditional branch
+	and needs no locking in threaded mode.
+*/
+
+class BRANCH_PROFILER{
+ private:
+  PC_MAP<PC_BRANCH> branches;
+  vector<PC_MAP<PC_MISSES> *> misses;
+
+ public:
+  BRANCH_PROFILER(int numPred);
+  ~BRANCH_PROFILER();
+
+  void Clear();
+
+  void CountBranches(const CBP_TRACE_RECORD *br, UINT32 n){
+    for (UINT32 i = 0; i < n; i++) {
+      PC_BRANCH *b = branches.Insert(br[i].PC);
+      b->count++;
+      b->numTaken += br[i].branchTaken;
+    }
+  }
+
+  PC_MAP<PC_MISSES> *Misses(int pred){ return misses[pred]; }
+
+  // Top-N offenders, cumulative-miss curve and bias summary per predictor
+  void Report(FILE *out, int topN);
+
+  // Every static branch: executions, taken bias, misses per predictor
+  bool WriteCsv(const char *fileName);
+};
+
+/////////////////////////////////////////////////////////////
+
+#endif // _PROFILER_H_
@@ -0,0 +1,387 @@
+#ifndef _TAGE_H_
+#define _TAGE_H_
+
+#include "utils.h"
+#include "predictor.h"
+
+/////////////////////////////////////////////////////////////
+// TAGE over a PAp base predictor (T0)
+/////////////////////////////////////////////////////////////
+
+/*
+	The number of tagged tables, their size, tag width and history lengths
+	are template parameters, so every loop over the tables has a constant
+	trip count and every mask is a constant:
+
+		TAGE_PREDICTOR<LOG_ENTRIES, TAG_BITS, HIST_BITS...>
+
+	One tagged table per entry of HIST_BITS, each with 2^LOG_ENTRIES entries.
+	An entry is packed into 16 bits: a 3-bit prediction counter, the tag and
+	a useful bit. GetPrediction computes the tag and index of every table
+	once and keeps them, together with the provider and alternate
+	prediction, for UpdatePredictor; the harness always updates the branch
+	it has just predicted.
+
+	The global history is a circular bitset and each folded history (CSR)
+	a plain integer updated in O(1) per branch. By default the CSRs are a
+	proper binary fold of the full history length. With compatFold set they
+	reproduce the openend algorithm as written for the lab (see
+	predictor.cc), including its decimal-weighted getCSR, so predictions are
+	bit-identical to the original and MPKI changes can be compared.
+*/
+
+// T0: PAp base predictor
+#define TAGE_T0_PHRT_ENTRIES 1024
+#define TAGE_T0_PHT_TABLES   8
+#define TAGE_T0_PHT_ENTRIES  512
+#define TAGE_T0_PHT_MODES    8
+#define TAGE_T0_PHT_PC_BITS  3
+
+// Tagged tables
+#define TAGE_PRED_MODES      8
+#define TAGE_CTR_BITS        3
+#define TAGE_USE_MAX         255
+#define TAGE_USE_RESET       128
+
+template <int... HIST_BITS> class TAGE_HIST_LIST;
+
+template <> class TAGE_HIST_LIST<> {
+ public:
+	static const int MAX = 0;
+};
+
+template <int FIRST, int... REST> class TAGE_HIST_LIST<FIRST, REST...> {
+ public:
+	static const int MAX = FIRST > TAGE_HIST_LIST<REST...>::MAX ? FIRST : TAGE_HIST_LIST<REST...>::MAX;
+};
+
+template <int LOG_ENTRIES, int TAG_BITS, int... HIST_BITS>
+class TAGE_PREDICTOR : public BRANCH_PREDICTOR {
+ public:
+	static const int NUM_TABLES  = sizeof...(HIST_BITS);
+	static const int NUM_ENTRIES = 1 << LOG_ENTRIES;
+	static const int GHR_BITS    = TAGE_HIST_LIST<HIST_BITS...>::MAX;
+
+ private:
+	static_assert(TAGE_CTR_BITS + TAG_BITS + 1 <= 16, "TAGE entry must fit in 16 bits");
+	static_assert(NUM_TABLES > 0, "TAGE needs at least one tagged table");
+
+	// Packed entry layout
+	static const UINT16 CTR_MASK   = (1 << TAGE_CTR_BITS) - 1;
+	static const int    TAG_SHIFT  = TAGE_CTR_BITS;
+	static const UINT16 TAG_MASK   = (1 << TAG_BITS) - 1;
+	static const UINT16 USE_BIT    = 1 << (TAGE_CTR_BITS + TAG_BITS);
+
+	// Tags are masked to the index width, as in the original openend
+	static const UINT32 INDEX_MASK = NUM_ENTRIES - 1;
+
+	// Smallest power of two above GHR_BITS, at least one word, so the
+	// bit leaving the longest window is still in the ring after a push
+	static constexpr int RingSize(int n, int size) {
+		return size > n ? size : RingSize(n, size * 2);
+	}
+	static const int GHR_SIZE  = RingSize(GHR_BITS, 64);
+	static const int GHR_WORDS = GHR_SIZE / 64;
+
+	static const int DECIMAL_ENTRIES = 1 << (TAG_BITS-1);
+
+	const int histBits[NUM_TABLES] = {HIST_BITS...};
+
+	int T0Phrt[TAGE_T0_PHRT_ENTRIES];
+	int T0Pht[TAGE_T0_PHT_TABLES][TAGE_T0_PHT_ENTRIES];
+
+	UINT16 table[NUM_TABLES][NUM_ENTRIES];
+
+	// Global history as a circular bitset: the outcome of age a (0 is the
+	// newest) is bit ghrHead-a. Two folded registers per table, TAG_BITS
+	// and TAG_BITS-1 wide, are kept up to date in O(1) per branch.
+	UINT64 ghr[GHR_WORDS];
+	UINT32 ghrHead;
+	UINT32 CSR[NUM_TABLES][2];
+
+	bool   compat;
+	UINT32 decimal[DECIMAL_ENTRIES];
+
+	int probability;
+	int useCounter;
+
+	// Lookup results from GetPrediction, reused by UpdatePredictor
+	UINT32 tag[NUM_TABLES];
+	UINT32 index[NUM_TABLES];
+	int providerComp;     // 0 for T0, else 1-based tagged table
+	int providerPred;
+	int providerIndex;
+	int altPred;
+
+	static int    Ctr(UINT16 e) { return e & CTR_MASK; }
+	static UINT32 Tag(UINT16 e) { return (e >> TAG_SHIFT) & TAG_MASK; }
+	static bool   Useful(UINT16 e) { return (e & USE_BIT) != 0; }
+	static UINT16 Pack(int ctr, UINT32 t, bool u) {
+		return (UINT16)(ctr | (t << TAG_SHIFT) | (u ? USE_BIT : 0));
+	}
+
+	// START T0 //////////////////////////////////////////////////////////
+	void initT0() {
+		int i, j;
+		for (i = 0; i < TAGE_T0_PHRT_ENTRIES; i++)
+			T0Phrt[i] = 0;
+		for (i = 0; i < TAGE_T0_PHT_TABLES; i++)
+			for (j = 0; j < TAGE_T0_PHT_ENTRIES; j++)
+				T0Pht[i][j] = (TAGE_T0_PHT_MODES/2)-1;
+	}
+
+	unsigned getT0(UINT32 PC) {
+		unsigned phrtIndex = (PC >> TAGE_T0_PHT_PC_BITS) & (TAGE_T0_PHRT_ENTRIES-1);
+		unsigned phtIndex = PC & (TAGE_T0_PHT_TABLES-1);
+		unsigned mode = T0Pht[phtIndex][T0Phrt[phrtIndex]];
+		if (mode <= ((TAGE_T0_PHT_MODES/2)-1)) return NOT_TAKEN;
+		else return TAKEN;
+	}
+
+	void updateT0(UINT32 PC, bool resolveDir) {
+		unsigned phrtIndex = (PC >> TAGE_T0_PHT_PC_BITS) & (TAGE_T0_PHRT_ENTRIES-1);
+		unsigned phtIndex = PC & (TAGE_T0_PHT_TABLES-1);
+		int *mode = &T0Pht[phtIndex][T0Phrt[phrtIndex]];
+		if ((resolveDir == NOT_TAKEN) && (*mode != 0)) (*mode)--;
+		if ((resolveDir == TAKEN) && (*mode != (TAGE_T0_PHT_MODES-1))) (*mode)++;
+		T0Phrt[phrtIndex] = ((T0Phrt[phrtIndex] << 1) & (TAGE_T0_PHT_ENTRIES-1)) | (unsigned)resolveDir;
+	}
+	// END T0 ////////////////////////////////////////////////////////////
+
+	// START CSR //////////////////////////////////////////////////////////
+	bool ghrBit(int age) {
+		UINT32 pos = (ghrHead - age) & (GHR_SIZE-1);
+		return (ghr[pos >> 6] >> (pos & 63)) & 1;
+	}
+
+	void pushGHR(bool resolveDir) {
+		ghrHead = (ghrHead + 1) & (GHR_SIZE-1);
+		if (resolveDir) ghr[ghrHead >> 6] |= 1ULL << (ghrHead & 63);
+		else            ghr[ghrHead >> 6] &= ~(1ULL << (ghrHead & 63));
+	}
+
+	// Rotate a WIDTH-bit folded register left by one, insert the newest
+	// history bit and cancel the bit leaving the window, which has been
+	// rotated to position age % WIDTH by now
+	template <int WIDTH>
+	static UINT32 fold(UINT32 csr, bool newBit, bool oldBit, int age) {
+		csr = ((csr << 1) | (csr >> (WIDTH-1))) & ((1 << WIDTH) - 1);
+		return csr ^ (UINT32)newBit ^ ((UINT32)oldBit << (age % WIDTH));
+	}
+
+	// Called after the new outcome has been pushed. The original lab code
+	// cancelled bit histBits-1 instead of histBits, so in compat mode each
+	// table really sees one bit less history than its nominal length.
+	void updateCSR(int t) {
+		int age = compat ? histBits[t]-1 : histBits[t];
+		bool newBit = ghrBit(0);
+		bool oldBit = ghrBit(age);
+		CSR[t][0] = fold<TAG_BITS>(CSR[t][0], newBit, oldBit, age);
+		CSR[t][1] = fold<TAG_BITS-1>(CSR[t][1], newBit, oldBit, age);
+	}
+
+	// The original getCSR summed the register bits with weights 1, 10,
+	// 100, ... and read only the low TAG_BITS-1 bits of both registers;
+	// compat mode maps the folded value through the same weighting
+	UINT32 getCSR(int t, int num) {
+		if (!compat) return CSR[t][num];
+		return decimal[CSR[t][num] & (DECIMAL_ENTRIES-1)];
+	}
+
+	void initDecimal() {
+		for (int v = 0; v < DECIMAL_ENTRIES; v++) {
+			unsigned int pow = 1;
+			unsigned int sum = 0;
+			for (int i = 0; i < TAG_BITS-1; i++) {
+				sum += pow * ((v >> i) & 1);
+				pow *= 10;
+			}
+			decimal[v] = sum;
+		}
+	}
+	// END CSR ////////////////////////////////////////////////////////////
+
+	void allocate(int t, int initialPred) {
+		table[t][index[t]] = Pack(initialPred, tag[t], false);
+	}
+
+	void clearUseful(int t) {
+		for (int i = 0; i < NUM_ENTRIES; i++)
+			table[t][i] &= ~USE_BIT;
+	}
+
+ public:
+	TAGE_PREDICTOR(bool compatFold = false) : compat(compatFold) {}
+
+	void Init() {
+		int t, i;
+
+		// Initialize T0 PaP
+		initT0();
+
+		// Initialize the GHR and CSRs
+		for (i = 0; i < GHR_WORDS; i++)
+			ghr[i] = 0;
+		ghrHead = 0;
+		for (t = 0; t < NUM_TABLES; t++) {
+			CSR[t][0] = 0;
+			CSR[t][1] = 0;
+		}
+		if (compat) initDecimal();
+
+		// Initialize the tagged tables
+		for (t = 0; t < NUM_TABLES; t++)
+			for (i = 0; i < NUM_ENTRIES; i++)
+				table[t][i] = Pack((TAGE_PRED_MODES/2)-1, 0, false);
+
+		providerComp = 0;
+		providerPred = 0;
+		providerIndex = 0;
+		altPred = 0;
+		probability = 0;
+		useCounter = TAGE_USE_RESET;
+	}
+
+	void Checkpoint(PREDICTOR_STATE &state) {
+		state.Array(&T0Phrt[0], TAGE_T0_PHRT_ENTRIES);
+		state.Array(&T0Pht[0][0], TAGE_T0_PHT_TABLES * TAGE_T0_PHT_ENTRIES);
+		state.Array(&table[0][0], NUM_TABLES * NUM_ENTRIES);
+		state.Array(ghr, GHR_WORDS);
+		state.Field(ghrHead);
+		state.Array(&CSR[0][0], NUM_TABLES * 2);
+		state.Field(probability);
+		state.Field(useCounter);
+	}
+
+	// The decimal weights of compat folding are arithmetic, not state
+	void Storage(STORAGE_BUDGET &budget) {
+		char name[32];
+		budget.Table("T0 history registers", TAGE_T0_PHRT_ENTRIES, BitsFor(TAGE_T0_PHT_ENTRIES), 0);
+		budget.Table("T0 pattern counters", TAGE_T0_PHT_TABLES * TAGE_T0_PHT_ENTRIES, BitsFor(TAGE_T0_PHT_MODES), 1);
+		for (int t = 0; t < NUM_TABLES; t++) {
+			snprintf(name, sizeof(name), "T%d", t + 1);
+			budget.Table(name, NUM_ENTRIES, TAGE_CTR_BITS + TAG_BITS + 1, 0);
+		}
+		budget.Register("global history", GHR_BITS);
+		budget.Table("folded histories", NUM_TABLES, 2 * TAG_BITS - 1, STORAGE_NO_STAGE);
+		budget.Register("useful counter", BitsFor(TAGE_USE_MAX + 1));
+		budget.Register("allocation toggle", 2);
+	}
+
+	bool GetPrediction(UINT32 PC) {
+		int t, j;
+		bool hit[NUM_TABLES];
+
+		// Set T0 as the default predictor component
+		providerComp = 0;
+		providerPred = getT0(PC);
+		providerIndex = -1;
+		altPred = providerPred;
+
+		// Compute every tag and index once; UpdatePredictor reuses them
+		for (t = 0; t < NUM_TABLES; t++) {
+			UINT32 csr0 = getCSR(t, 0);
+			UINT32 csr1 = getCSR(t, 1);
+			tag[t] = (PC ^ csr0 ^ (csr1 << 1)) & INDEX_MASK;
+			index[t] = (PC ^ (PC >> TAG_BITS) ^ csr1) & INDEX_MASK;
+			hit[t] = Tag(table[t][index[t]]) == tag[t];
+		}
+
+		// Provide prediction from the highest component. If weak, provide altPred.
+		bool weak = false;
+		for (t = NUM_TABLES - 1; t >= 0; t--) {
+			if (!hit[t]) continue;
+			UINT16 e = table[t][index[t]];
+			int ctr = Ctr(e);
+			providerComp = t + 1;
+			providerPred = (ctr<(TAGE_PRED_MODES/2))?NOT_TAKEN:TAKEN;
+			providerIndex = index[t];
+			if (((ctr > 2) && (ctr < 5)) || !Useful(e)) weak = true;
+			for (j = t - 1; j >= 0; j--) {
+				if (hit[j]) {
+					altPred = providerPred;
+					break;
+				}
+			}
+			break;
+		}
+
+		return weak?altPred:providerPred;
+	}
+
+	void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+		int t;
+
+		// Update T0 PaP
+		updateT0(PC, resolveDir);
+
+		int useful = 0, pred = 0;
+		if (providerComp != 0) {
+			UINT16 *e = &table[providerComp-1][providerIndex];
+			int ctr = Ctr(*e);
+
+			// Always update prediction bits for the provider component
+			if ((resolveDir == TAKEN) && (ctr != TAGE_PRED_MODES-1)) {
+				ctr++;
+				useful = Useful(*e);
+				pred = ctr;
+			} else if ((resolveDir == NOT_TAKEN) && (ctr != 0)) {
+				ctr--;
+				useful = Useful(*e);
+				pred = ctr;
+			}
+			*e = (*e & ~CTR_MASK) | ctr;
+
+			// Update useful bit according to the method describes in [2]
+			if ((providerPred == resolveDir) && (providerPred != altPred)) {
+				*e |= USE_BIT;
+				if (useCounter != TAGE_USE_MAX) useCounter++;
+			} else if ((providerPred != resolveDir) && (providerPred != altPred)) {
+				*e &= ~USE_BIT;
+				if (useCounter != 0) useCounter--;
+			}
+		}
+
+		if ((providerComp != NUM_TABLES) && ((resolveDir != providerPred) && !((useful == 0) && (pred > 2) && (pred < 5)))) {
+
+			int initialPred = resolveDir?4:3;
+			int found[2];
+			int numFound = 0;
+
+			// Look for up to two entries without the useful bit above the provider
+			for (t = providerComp; (t < NUM_TABLES) && (numFound < 2); t++) {
+				if (!Useful(table[t][index[t]]))
+					found[numFound++] = t;
+			}
+
+			// If an empty entry is not found, reset all the useful bits
+			// If only one entry is found, allocate it
+			// If multiple entries are found, use 1/2 probability to allocate a higher table
+			// and 1/2 probability to occupy the lower-numbered table as suggested it gives better results.
+			if (numFound == 0) {
+				for (t = providerComp; t < NUM_TABLES; t++)
+					clearUseful(t);
+			} else if ((numFound == 1) || (probability < 2)) {
+				allocate(found[0], initialPred);
+				probability++;
+			} else {
+				probability = 1;
+				allocate(found[1], initialPred);
+			}
+		}
+
+		// Reset all the useful bits when the useful counter is sturated
+		if (useCounter == 0) {
+			for (t = 0; t < NUM_TABLES; t++)
+				clearUseful(t);
+			useCounter = TAGE_USE_RESET;
+		}
+
+		// Update the GHR and the CSRs for each table
+		pushGHR(resolveDir);
+		for (t = 0; t < NUM_TABLES; t++)
+			updateCSR(t);
+	}
+};
+
+#endif
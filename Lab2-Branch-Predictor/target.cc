@@ -0,0 +1,507 @@
+#include <string.h>
+#include <math.h>
+#include "target.h"
+
+/* REFERENCES
+
+[1] K. Skadron, P. S. Ahuja, M. Martonosi and D. W. Clark, "Improving Prediction for Procedure Returns with
+	Return-Address-Stack Repair Mechanisms," in The 31st Annual International Symposium on Microarchitecture, 1998.
+
+[2] A. Seznec, "A 64-Kbytes ITTAGE indirect branch predictor," in The 3rd JILP Workshop on Computer
+	Architecture Competitions (JWAC-2): Championship Branch Prediction, 2011.
+
+*/
+
+// Top bits of two independent multiplicative hashes of the PC, for set
+// or table indices and for tags. Trace PCs are often aligned, so their
+// low bits alone would leave most rows unused.
+static UINT32 IndexHash(UINT32 PC, int bits) {
+	return bits ? (PC * 0x9E3779B1u) >> (32 - bits) : 0;
+}
+
+static UINT32 TagHash(UINT32 PC, int bits) {
+	return bits ? (PC * 0x85EBCA6Bu) >> (32 - bits) : 0;
+}
+
+static int Log2(UINT32 x) {
+	int n = 0;
+	while (x > 1) { x >>= 1; n++; }
+	return n;
+}
+
+/////////////////////////////////////////////////////////////
+// btb
+/////////////////////////////////////////////////////////////
+
+/*
+	Set-associative branch target buffer with true LRU. It is looked up
+	for every taken branch except returns, which the ras family covers;
+	taken branches allocate on a miss, not-taken ones leave it alone.
+	Indirect branches get the last target seen.
+*/
+
+class BTB_ENTRY{
+  public:
+  UINT32 target;
+  UINT16 tag;
+  UINT8  valid;
+  UINT8  age;        // 0 = most recently used in its set
+};
+
+class BTB_PREDICTOR : public TARGET_PREDICTOR {
+ private:
+	int    logSets;
+	int    numWays;
+	int    tagBits;
+	BTB_ENTRY *entries;     // 2^logSets x numWays
+
+	BTB_ENTRY *Find(UINT32 PC) {
+		BTB_ENTRY *set = &entries[IndexHash(PC, logSets) * numWays];
+		UINT16 tag = TagHash(PC, tagBits);
+		for (int w = 0; w < numWays; w++) {
+			if (set[w].valid && set[w].tag == tag) return &set[w];
+		}
+		return NULL;
+	}
+
+	void Touch(BTB_ENTRY *set, BTB_ENTRY *e) {
+		for (int w = 0; w < numWays; w++) {
+			if (set[w].age < e->age) set[w].age++;
+		}
+		e->age = 0;
+	}
+
+ public:
+	BTB_PREDICTOR(UINT32 sets, int ways, int tag) {
+		logSets = Log2(sets);
+		numWays = ways;
+		tagBits = tag;
+		entries = new BTB_ENTRY[sets * ways];
+	}
+	~BTB_PREDICTOR() { delete [] entries; }
+
+	void Init();
+	bool Predicts(OpType opType) { return opType >= OPTYPE_CALL_DIRECT && opType < OPTYPE_MAX && opType != OPTYPE_RET; }
+	UINT32 GetTarget(UINT32 PC, OpType opType);
+	void Update(UINT32 PC, OpType opType, bool taken, UINT32 target);
+	void Checkpoint(PREDICTOR_STATE &state) { state.Array(entries, numWays << logSets); }
+	// A lookup reads a whole set: per way a valid bit, tag, target and LRU age
+	void Storage(STORAGE_BUDGET &budget) {
+		budget.Table("sets", 1 << logSets, numWays * (1 + tagBits + 32 + BitsFor(numWays)), 0);
+	}
+};
+
+void BTB_PREDICTOR::Init() {
+	for (int i = 0; i < (numWays << logSets); i++) {
+		entries[i].target = 0;
+		entries[i].tag = 0;
+		entries[i].valid = 0;
+		entries[i].age = i % numWays;
+	}
+}
+
+UINT32 BTB_PREDICTOR::GetTarget(UINT32 PC, OpType opType) {
+	BTB_ENTRY *e = Find(PC);
+	return e ? e->target : 0;
+}
+
+void BTB_PREDICTOR::Update(UINT32 PC, OpType opType, bool taken, UINT32 target) {
+	if (!taken || !Predicts(opType)) return;
+
+	BTB_ENTRY *set = &entries[IndexHash(PC, logSets) * numWays];
+	BTB_ENTRY *e = Find(PC);
+	if (e == NULL) {
+		// Replace the least recently used way
+		e = &set[0];
+		for (int w = 1; w < numWays; w++) {
+			if (set[w].age > e->age) e = &set[w];
+		}
+		e->tag = TagHash(PC, tagBits);
+		e->valid = 1;
+	}
+	e->target = target;
+	Touch(set, e);
+}
+
+static TARGET_PREDICTOR *CreateBtb(PREDICTOR_PARAMS &params) {
+	UINT32 entries = params.GetPow2("entries", 4096);
+	UINT32 ways = params.GetPow2("ways", 4);
+	UINT32 tag = params.GetUInt("tag", 16);
+	if (ways > entries || ways > 64) {
+		printf("ways of btb must be at most entries and 64. Dying\n");
+		exit(-1);
+	}
+	if (tag < 1 || tag > 16) {
+		printf("tag of btb must be 1..16. Dying\n");
+		exit(-1);
+	}
+	return new BTB_PREDICTOR(entries / ways, ways, tag);
+}
+
+REGISTER_TARGET_PREDICTOR(regBtb, "btb", CreateBtb,
+	"set-associative BTB, LRU, all taken branches but returns [entries=4096:ways=4:tag=16]");
+
+/////////////////////////////////////////////////////////////
+// ras
+/////////////////////////////////////////////////////////////
+
+/*
+	Circular return address stack [1]: calls push, returns pop, and an
+	overflow overwrites the oldest entry. The trace gives a call's PC but
+	not its length, so the stack holds call PCs and a small table keyed by
+	call site learns the distance from the call to its return address
+	(x86 direct calls are 5 bytes, the starting guess). Indirect branch
+	records are calls in most traces and push too unless indirect=0.
+*/
+
+#define RAS_DEFAULT_CALL_BYTES  5
+#define RAS_MAX_CALL_BYTES      15
+
+class RAS_PREDICTOR : public TARGET_PREDICTOR {
+ private:
+	int    depth;
+	UINT32 *stack;          // call PCs
+	int    top;             // next free slot
+	int    count;           // valid entries, at most depth
+	int    logSites;
+	UINT8  *callBytes;      // per call site: return address - call PC
+	bool   pushIndirect;
+
+ public:
+	RAS_PREDICTOR(int stackDepth, UINT32 sites, bool indirect) {
+		depth = stackDepth;
+		logSites = Log2(sites);
+		pushIndirect = indirect;
+		stack = new UINT32[depth];
+		callBytes = new UINT8[sites];
+	}
+	~RAS_PREDICTOR() { delete [] stack; delete [] callBytes; }
+
+	void Init();
+	bool Predicts(OpType opType) { return opType == OPTYPE_RET; }
+	UINT32 GetTarget(UINT32 PC, OpType opType);
+	void Update(UINT32 PC, OpType opType, bool taken, UINT32 target);
+	void Checkpoint(PREDICTOR_STATE &state) {
+		state.Array(stack, depth);
+		state.Field(top);
+		state.Field(count);
+		state.Array(callBytes, 1 << logSites);
+	}
+	void Storage(STORAGE_BUDGET &budget) {
+		budget.Table("stack", depth, 32, 0);
+		budget.Table("call lengths", 1 << logSites, BitsFor(RAS_MAX_CALL_BYTES + 1), 1);
+		budget.Register("top", BitsFor(depth));
+		budget.Register("count", BitsFor(depth + 1));
+	}
+};
+
+void RAS_PREDICTOR::Init() {
+	memset(stack, 0, depth * sizeof(UINT32));
+	memset(callBytes, RAS_DEFAULT_CALL_BYTES, 1 << logSites);
+	top = 0;
+	count = 0;
+}
+
+UINT32 RAS_PREDICTOR::GetTarget(UINT32 PC, OpType opType) {
+	if (count == 0) return 0;
+	UINT32 callPC = stack[(top + depth - 1) % depth];
+	return callPC + callBytes[IndexHash(callPC, logSites)];
+}
+
+void RAS_PREDICTOR::Update(UINT32 PC, OpType opType, bool taken, UINT32 target) {
+	if (opType == OPTYPE_CALL_DIRECT || (opType == OPTYPE_INDIRECT_BR_CALL && pushIndirect)) {
+		stack[top] = PC;
+		top = (top + 1) % depth;
+		if (count < depth) count++;
+	} else if (opType == OPTYPE_RET && count > 0) {
+		top = (top + depth - 1) % depth;
+		count--;
+		UINT32 offset = target - stack[top];
+		if (offset >= 1 && offset <= RAS_MAX_CALL_BYTES)
+			callBytes[IndexHash(stack[top], logSites)] = offset;
+	}
+}
+
+static TARGET_PREDICTOR *CreateRas(PREDICTOR_PARAMS &params) {
+	UINT32 depth = params.GetUInt("depth", 16);
+	UINT32 indirect = params.GetUInt("indirect", 1);
+	if (depth < 1 || depth > 1024) {
+		printf("depth of ras must be 1..1024. Dying\n");
+		exit(-1);
+	}
+	if (indirect > 1) {
+		printf("indirect of ras must be 0 or 1. Dying\n");
+		exit(-1);
+	}
+	return new RAS_PREDICTOR(depth, params.GetPow2("sites", 1024), indirect == 1);
+}
+
+REGISTER_TARGET_PREDICTOR(regRas, "ras", CreateRas,
+	"return address stack, learned call lengths [depth=16:sites=1024:indirect=1]");
+
+/////////////////////////////////////////////////////////////
+// ittage
+/////////////////////////////////////////////////////////////
+
+/*
+	ITTAGE-style indirect target predictor [2]: a tagless base table of
+	last targets plus tagged tables indexed with geometrically longer
+	global histories. The history takes every conditional outcome and two
+	hashed bits of every indirect target, and each table keeps it folded
+	into index and tag widths so a push costs O(tables).
+
+	Tagged entries carry a valid bit, a target, a 2-bit confidence and a
+	useful bit. The longest hitting table provides the prediction unless
+	its entry is newly allocated (confidence 0), in which case the next
+	hit, or the base table, does. A misprediction allocates one entry in a
+	longer table whose useful bit is clear, or clears the useful bits if
+	none is. Every ITTAGE_USE_PERIOD indirect branches all useful bits are
+	cleared, so entries that stopped being useful can be replaced.
+*/
+
+#define ITTAGE_MAX_TABLES  16
+#define ITTAGE_MAX_HIST    1024
+#define ITTAGE_MIN_HIST    4
+#define ITTAGE_TAG_BITS    12
+#define ITTAGE_CONF_MAX    3
+#define ITTAGE_USE_PERIOD  (1 << 16)
+
+class ITTAGE_ENTRY{
+  public:
+  UINT32 target;
+  UINT16 tag;
+  UINT8  conf;
+  UINT8  useful;
+  UINT8  valid;   // tagged tables only
+};
+
+// Newest len history bits XOR-folded to width bits, updated per push
+class FOLDED_HISTORY{
+ public:
+	UINT32 value;
+	int    width;
+	int    outPoint;    // len % width, where the bit leaving the history lands
+
+	void Push(UINT32 in, UINT32 out) {
+		value = (value << 1) | in;
+		value ^= out << outPoint;
+		value ^= value >> width;
+		value &= (1u << width) - 1;
+	}
+};
+
+class ITTAGE_PREDICTOR : public TARGET_PREDICTOR {
+ private:
+	int    numTables;
+	int    logEntries;
+	int    logBase;
+	int    histLen[ITTAGE_MAX_TABLES];
+
+	ITTAGE_ENTRY *base;     // 2^logBase, tags unused
+	ITTAGE_ENTRY *tagged;   // numTables x 2^logEntries
+
+	UINT8 *hist;            // ring of history bits
+	UINT32 histMask;
+	UINT32 histHead;
+	FOLDED_HISTORY foldIndex[ITTAGE_MAX_TABLES];
+	FOLDED_HISTORY foldTag[ITTAGE_MAX_TABLES];
+	FOLDED_HISTORY foldTag2[ITTAGE_MAX_TABLES];
+	UINT32 useTick;         // indirect branches since the useful bits were cleared
+
+	// From Lookup
+	UINT32 index[ITTAGE_MAX_TABLES];
+	UINT16 tag[ITTAGE_MAX_TABLES];
+	int    provider;        // table number, -1 for the base table
+	UINT32 providerTarget;
+	UINT32 altTarget;
+	UINT32 predTarget;
+
+	ITTAGE_ENTRY &Entry(int t) { return tagged[(t << logEntries) + index[t]]; }
+	ITTAGE_ENTRY &Base(UINT32 PC) { return base[IndexHash(PC ^ 0x5bd1e995u, logBase)]; }
+
+	void Lookup(UINT32 PC);
+	void PushHistory(UINT32 bit);
+
+	static void Train(ITTAGE_ENTRY &e, UINT32 target) {
+		if (e.target == target) {
+			if (e.conf < ITTAGE_CONF_MAX) e.conf++;
+		} else if (e.conf > 0) {
+			e.conf--;
+		} else {
+			e.target = target;
+		}
+	}
+
+ public:
+	ITTAGE_PREDICTOR(int tables, int logEntriesLen, int logBaseLen, int maxHist) {
+		numTables = tables;
+		logEntries = logEntriesLen;
+		logBase = logBaseLen;
+		for (int t = 0; t < numTables; t++) {
+			double ratio = (numTables > 1) ? (double)t / (numTables - 1) : 1.0;
+			int len = (int)(ITTAGE_MIN_HIST * pow((double)maxHist / ITTAGE_MIN_HIST, ratio) + 0.5);
+			histLen[t] = (t == 0 || len > histLen[t-1]) ? len : histLen[t-1] + 1;
+		}
+		UINT32 ringSize = 1;
+		while (ringSize <= (UINT32)histLen[numTables-1]) ringSize <<= 1;
+		histMask = ringSize - 1;
+		base = new ITTAGE_ENTRY[1 << logBase];
+		tagged = new ITTAGE_ENTRY[numTables << logEntries];
+		hist = new UINT8[ringSize];
+	}
+	~ITTAGE_PREDICTOR() { delete [] base; delete [] tagged; delete [] hist; }
+
+	void Init();
+	bool Predicts(OpType opType) { return opType == OPTYPE_INDIRECT_BR_CALL; }
+	UINT32 GetTarget(UINT32 PC, OpType opType);
+	void Update(UINT32 PC, OpType opType, bool taken, UINT32 target);
+	void Checkpoint(PREDICTOR_STATE &state) {
+		state.Array(base, 1 << logBase);
+		state.Array(tagged, numTables << logEntries);
+		state.Array(hist, histMask + 1);
+		state.Field(histHead);
+		state.Array(foldIndex, numTables);
+		state.Array(foldTag, numTables);
+		state.Array(foldTag2, numTables);
+		state.Field(useTick);
+	}
+	void Storage(STORAGE_BUDGET &budget) {
+		char name[32];
+		budget.Table("base", 1 << logBase, 32 + BitsFor(ITTAGE_CONF_MAX + 1), 0);
+		for (int t = 0; t < numTables; t++) {
+			snprintf(name, sizeof(name), "T%d", t + 1);
+			budget.Table(name, 1 << logEntries, 1 + 32 + ITTAGE_TAG_BITS + BitsFor(ITTAGE_CONF_MAX + 1) + 1, 0);
+		}
+		budget.Register("global history", histLen[numTables-1]);
+		budget.Register("useful reset tick", BitsFor(ITTAGE_USE_PERIOD));
+		budget.Table("folded histories", numTables, logEntries + 2 * ITTAGE_TAG_BITS - 1, STORAGE_NO_STAGE);
+	}
+};
+
+void ITTAGE_PREDICTOR::Init() {
+	memset(base, 0, sizeof(ITTAGE_ENTRY) << logBase);
+	memset(tagged, 0, sizeof(ITTAGE_ENTRY) * (numTables << logEntries));
+	memset(hist, 0, histMask + 1);
+	histHead = 0;
+	for (int t = 0; t < numTables; t++) {
+		foldIndex[t].value = 0;
+		foldIndex[t].width = logEntries;
+		foldIndex[t].outPoint = histLen[t] % foldIndex[t].width;
+		foldTag[t].value = 0;
+		foldTag[t].width = ITTAGE_TAG_BITS;
+		foldTag[t].outPoint = histLen[t] % foldTag[t].width;
+		foldTag2[t].value = 0;
+		foldTag2[t].width = ITTAGE_TAG_BITS - 1;
+		foldTag2[t].outPoint = histLen[t] % foldTag2[t].width;
+	}
+	useTick = 0;
+	provider = -1;
+	providerTarget = altTarget = predTarget = 0;
+}
+
+void ITTAGE_PREDICTOR::Lookup(UINT32 PC) {
+	UINT32 pcIndex = IndexHash(PC, logEntries);
+	UINT32 pcTag = TagHash(PC, ITTAGE_TAG_BITS);
+	int alt = -1;
+
+	provider = -1;
+	for (int t = numTables - 1; t >= 0; t--) {
+		index[t] = pcIndex ^ foldIndex[t].value;
+		tag[t] = (pcTag ^ foldTag[t].value ^ (foldTag2[t].value << 1)) & ((1 << ITTAGE_TAG_BITS) - 1);
+		if (Entry(t).valid && Entry(t).tag == tag[t]) {
+			if (provider < 0) provider = t;
+			else if (alt < 0) alt = t;
+		}
+	}
+
+	altTarget = (alt >= 0) ? Entry(alt).target : Base(PC).target;
+	providerTarget = (provider >= 0) ? Entry(provider).target : altTarget;
+	predTarget = providerTarget;
+	if (provider >= 0 && Entry(provider).conf == 0 && altTarget != 0) predTarget = altTarget;
+}
+
+void ITTAGE_PREDICTOR::PushHistory(UINT32 bit) {
+	histHead = (histHead + 1) & histMask;
+	hist[histHead] = bit;
+	for (int t = 0; t < numTables; t++) {
+		UINT32 out = hist[(histHead - histLen[t]) & histMask];
+		foldIndex[t].Push(bit, out);
+		foldTag[t].Push(bit, out);
+		foldTag2[t].Push(bit, out);
+	}
+}
+
+UINT32 ITTAGE_PREDICTOR::GetTarget(UINT32 PC, OpType opType) {
+	Lookup(PC);
+	return predTarget;
+}
+
+void ITTAGE_PREDICTOR::Update(UINT32 PC, OpType opType, bool taken, UINT32 target) {
+	if (opType == OPTYPE_BRANCH_COND) {
+		PushHistory(taken);
+		return;
+	}
+	if (opType != OPTYPE_INDIRECT_BR_CALL) return;
+
+	Lookup(PC);
+
+	if (provider >= 0) {
+		ITTAGE_ENTRY &e = Entry(provider);
+		// Useful when it was right where the alternative would have been wrong
+		if (providerTarget != altTarget) e.useful = (providerTarget == target);
+		bool weak = (e.conf == 0);
+		Train(e, target);
+		if (weak) Train(Base(PC), target);
+	} else {
+		Train(Base(PC), target);
+	}
+
+	if (predTarget != target && provider < numTables - 1) {
+		int t;
+		for (t = provider + 1; t < numTables; t++) {
+			if (Entry(t).useful == 0) break;
+		}
+		if (t < numTables) {
+			ITTAGE_ENTRY &e = Entry(t);
+			e.target = target;
+			e.tag = tag[t];
+			e.conf = 0;
+			e.useful = 0;
+			e.valid = 1;
+		} else {
+			for (t = provider + 1; t < numTables; t++) Entry(t).useful = 0;
+		}
+	}
+
+	if (++useTick == ITTAGE_USE_PERIOD) {
+		for (UINT32 i = 0; i < ((UINT32)numTables << logEntries); i++) tagged[i].useful = 0;
+		useTick = 0;
+	}
+
+	UINT32 h = target * 0x9E3779B1u;
+	PushHistory(h >> 31);
+	PushHistory((h >> 30) & 1);
+}
+
+static TARGET_PREDICTOR *CreateIttage(PREDICTOR_PARAMS &params) {
+	UINT32 tables = params.GetUInt("tables", 6);
+	UINT32 entries = params.GetPow2("entries", 512);
+	UINT32 baseEntries = params.GetPow2("base", 1024);
+	UINT32 hist = params.GetUInt("hist", 128);
+	if (tables < 1 || tables > ITTAGE_MAX_TABLES) {
+		printf("tables of ittage must be 1..%d. Dying\n", ITTAGE_MAX_TABLES);
+		exit(-1);
+	}
+	if (hist < ITTAGE_MIN_HIST + tables || hist > ITTAGE_MAX_HIST) {
+		printf("hist of ittage must be %d + tables..%d. Dying\n", ITTAGE_MIN_HIST, ITTAGE_MAX_HIST);
+		exit(-1);
+	}
+	if (entries < 2 || entries > (1 << 20) || baseEntries > (1 << 20)) {
+		printf("entries of ittage must be 2..2^20 and base at most 2^20. Dying\n");
+		exit(-1);
+	}
+	return new ITTAGE_PREDICTOR(tables, Log2(entries), Log2(baseEntries), hist);
+}
+
+REGISTER_TARGET_PREDICTOR(regIttage, "ittage", CreateIttage,
+	"ITTAGE-style indirect predictor, geometric histories [tables=6:entries=512:base=1024:hist=128]");
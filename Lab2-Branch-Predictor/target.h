@@ -0,0 +1,52 @@
+#ifndef _TARGET_H_
+#define _TARGET_H_
+
+#include "utils.h"
+#include "tracer.h"
+#include "predictor.h"
+
+/////////////////////////////////////////////////////////////
+// Interface every target predictor implements
+/////////////////////////////////////////////////////////////
+
+/*
+	Target predictors see every control-flow record of the trace (direct
+	calls, returns, jumps, conditional and indirect branches) in program
+	order. For each taken record of a type the predictor claims with
+	Predicts, the harness asks GetTarget first and counts a misprediction
+	when the answer is not the branch's target; every record, predicted
+	or not, then goes to Update, so a return stack can see the calls and
+	an indirect predictor the conditional outcomes. Not-taken conditional
+	branches need no target and are never charged.
+*/
+
+class TARGET_PREDICTOR{
+ public:
+  string name;   // spec the instance was created from, e.g. "btb:entries=2048"
+
+  virtual ~TARGET_PREDICTOR(){}
+
+  virtual void   Init() = 0;
+  virtual bool   Predicts(OpType opType) = 0;
+
+  // Predicted target of the branch at PC, 0 when there is none
+  virtual UINT32 GetTarget(UINT32 PC, OpType opType) = 0;
+  virtual void   Update(UINT32 PC, OpType opType, bool taken, UINT32 target) = 0;
+
+  // Tables, stacks and histories; everything Init would reset
+  virtual void   Checkpoint(PREDICTOR_STATE &state) = 0;
+
+  // The same state in hardware bits, with the order of its reads
+  virtual void   Storage(STORAGE_BUDGET &budget) = 0;
+
+  const char *GetName(){ return name.c_str(); }
+};
+
+typedef REGISTRY<TARGET_PREDICTOR> TARGET_REGISTRY;
+
+#define REGISTER_TARGET_PREDICTOR(var, family, factory, help) \
+  static REGISTRAR<TARGET_PREDICTOR> var(family, factory, help)
+
+/////////////////////////////////////////////////////////////
+
+#endif // _TARGET_H_
@@ -0,0 +1,86 @@
+#include <sys/time.h>
+#include "utils.h"
+#include "tracer.h"
+
+/*
+	Measures trace decode throughput for the same trace file through:
+
+	a.	the original reader: popen("gunzip -c") and four fread calls per record
+	b.	CBP_TRACER::GetNextRecord, one record per call
+	c.	CBP_TRACER::GetNextBatch, CBP_TRACE_BATCH_SIZE records per call
+
+	No predictor work is done, so the numbers are pure trace-reading cost.
+*/
+
+// usage: tracebench <trace>
+
+static double Now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void Report(const char *name, UINT64 numInst, UINT64 numCondBranch, double secs) {
+	printf("\n%-14s: %10llu records %10llu cond_br %8.3f s %12.0f records/s",
+		name, numInst, numCondBranch, secs, (double)numInst / secs);
+}
+
+// The reader CBP_TRACER used before it decompressed in-process
+static void BenchPipe(char *traceFileName) {
+	char cmdString[1024];
+	FILE *traceFile;
+	CBP_TRACE_RECORD rec;
+	UINT64 numInst = 0, numCondBranch = 0;
+
+	sprintf(cmdString, "gunzip -c %s", traceFileName);
+	double start = Now();
+	if ((traceFile = popen(cmdString, "r")) == NULL) {
+		printf("Unable to open the trace file. Dying\n");
+		exit(-1);
+	}
+	while (true) {
+		fread(&rec.PC, 4, 1, traceFile);
+		fread(&rec.branchTarget, 4, 1, traceFile);
+		fread(&rec.opType, 1, 1, traceFile);
+		fread(&rec.branchTaken, 1, 1, traceFile);
+		if (feof(traceFile)) break;
+		numInst++;
+		if (rec.opType == OPTYPE_BRANCH_COND) numCondBranch++;
+	}
+	pclose(traceFile);
+	Report("popen+fread", numInst, numCondBranch, Now() - start);
+}
+
+static void BenchRecord(char *traceFileName) {
+	CBP_TRACE_RECORD rec;
+	double start = Now();
+	CBP_TRACER *tracer = new CBP_TRACER(traceFileName);
+	while (tracer->GetNextRecord(&rec));
+	Report("GetNextRecord", tracer->GetNumInst(), tracer->GetNumCondBranch(), Now() - start);
+	delete tracer;
+}
+
+static void BenchBatch(char *traceFileName) {
+	CBP_TRACE_RECORD *batch = new CBP_TRACE_RECORD[CBP_TRACE_BATCH_SIZE];
+	double start = Now();
+	CBP_TRACER *tracer = new CBP_TRACER(traceFileName);
+	while (tracer->GetNextBatch(batch, CBP_TRACE_BATCH_SIZE) > 0);
+	Report("GetNextBatch", tracer->GetNumInst(), tracer->GetNumCondBranch(), Now() - start);
+	delete tracer;
+	delete [] batch;
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc != 2) {
+		printf("usage: %s <trace>\n", argv[0]);
+		exit(-1);
+	}
+
+	BenchPipe(argv[1]);
+	BenchRecord(argv[1]);
+	BenchBatch(argv[1]);
+	printf("\n\n");
+
+	return 0;
+}
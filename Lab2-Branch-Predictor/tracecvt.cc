@@ -0,0 +1,80 @@
+#include <string.h>
+#include "utils.h"
+#include "tracer.h"
+
+/*
+	Converts a CBP trace into the pre-decoded branch file read by CBP_TRACER.
+
+	Only OPTYPE_BRANCH_COND records reach the predictors, so only those are
+	kept, each with the number of instructions since the previous conditional
+	branch. The header carries the total instruction count of the original
+	trace, so NUM_INSTRUCTIONS and MISPRED_PER_1K_INST stay exact when the
+	predictor is run on the converted file.
+*/
+
+// usage: tracecvt <trace> <branch file>
+
+int main(int argc, char* argv[]) {
+
+	if (argc != 3) {
+		printf("usage: %s <trace> <branch file>\n", argv[0]);
+		exit(-1);
+	}
+
+	CBP_TRACER *tracer = new CBP_TRACER(argv[1]);
+	CBP_TRACE_RECORD *batch = new CBP_TRACE_RECORD[CBP_TRACE_BATCH_SIZE];
+	CBP_BRANCH_RECORD *out = new CBP_BRANCH_RECORD[CBP_TRACE_BATCH_SIZE];
+	CBP_BRANCH_HEADER header;
+	UINT32 batchSize, numOut, i;
+	UINT64 gap = 0;
+	FILE *outFile;
+
+	if (tracer->IsBranchOnly()) {
+		printf("%s is already a branch file. Dying\n", argv[1]);
+		exit(-1);
+	}
+
+	if ((outFile = fopen(argv[2], "wb")) == NULL) {
+		printf("Unable to open the branch file. Dying\n");
+		exit(-1);
+	}
+
+	// The header is rewritten with the final counts once the trace is done
+	memset(&header, 0, sizeof(header));
+	fwrite(&header, sizeof(header), 1, outFile);
+
+	while ((batchSize = tracer->GetNextBatch(batch, CBP_TRACE_BATCH_SIZE)) > 0) {
+		numOut = 0;
+		for (i = 0; i < batchSize; i++) {
+			gap++;
+			if (batch[i].opType != OPTYPE_BRANCH_COND) continue;
+
+			if (gap > CBP_BRANCH_GAP_MASK) {
+				printf("\nOver %u instructions between branches. Dying\n", CBP_BRANCH_GAP_MASK);
+				exit(-1);
+			}
+			out[numOut].PC = batch[i].PC;
+			out[numOut].branchTarget = batch[i].branchTarget;
+			out[numOut].info = (UINT32)gap | (batch[i].branchTaken ? CBP_BRANCH_TAKEN_BIT : 0);
+			numOut++;
+			gap = 0;
+		}
+		if (fwrite(out, sizeof(CBP_BRANCH_RECORD), numOut, outFile) != numOut) {
+			printf("\nUnable to write the branch file. Dying\n");
+			exit(-1);
+		}
+	}
+
+	memcpy(header.magic, CBP_BRANCH_MAGIC, sizeof(header.magic));
+	header.numInst = tracer->GetNumInst();
+	header.numCondBranch = tracer->GetNumCondBranch();
+	fseek(outFile, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, outFile);
+	fclose(outFile);
+
+	printf("\nNUM_INSTRUCTIONS     \t : %10llu", header.numInst);
+	printf("\nNUM_CONDITIONAL_BR   \t : %10llu", header.numCondBranch);
+	printf("\n\n");
+
+	return 0;
+}
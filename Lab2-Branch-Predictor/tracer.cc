@@ -12,40 +12,157 @@
 // IMPORTANT NOTE: Changing anything in here will violate the competition rules.
 
 #include <assert.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tracer.h"
 
 /////////////////////////////////////////
 /////////////////////////////////////////
 
 CBP_TRACER::CBP_TRACER(char *traceFileName){
-  char  cmdString[1024];
-  
-  sprintf(cmdString,"gunzip -c %s", traceFileName);
 
-  if ((traceFile = popen(cmdString, "r")) == NULL){
+  traceFile=NULL;
+  block=NULL;
+  blockLen=0;
+  blockPos=0;
+
+  numInst=0;
+  numCondBranch=0;
+  instLimit=~0ULL;
+  lastHeartBeat=0;
+  heartBeat=true;
+
+  // A pre-decoded branch file is replayed straight from the mapping
+  if (MapBranchFile(traceFileName)){
+    return;
+  }
+
+  // Decompress in-process rather than through a "gunzip -c" pipe; zlib
+  // reads plain (uncompressed) traces transparently as well
+  if ((traceFile = gzopen(traceFileName, "rb")) == NULL){
    printf("Unable to open the trace file. Dying\n");
    exit(-1);
   }
+  gzbuffer(traceFile, CBP_TRACE_BLOCK_BYTES);
 
-  numInst=0;
-  numCondBranch=0;
+  block = new unsigned char[CBP_TRACE_BLOCK_BYTES];
 
 }
 
 /////////////////////////////////////////
 /////////////////////////////////////////
 
-bool  CBP_TRACER::GetNextRecord(CBP_TRACE_RECORD *rec){
+CBP_TRACER::~CBP_TRACER(){
+  if (branchOnly){
+    munmap(branchMap, branchMapLen);
+  } else {
+    gzclose(traceFile);
+    delete [] block;
+  }
+}
 
-  fread (&rec->PC, 4, 1, traceFile);
-  fread (&rec->branchTarget, 4, 1, traceFile);
-  fread (&rec->opType, 1, 1, traceFile);
-  fread (&rec->branchTaken, 1, 1, traceFile);
+/////////////////////////////////////////
+/////////////////////////////////////////
 
-  if(feof(traceFile)){
-    return FAILURE; 
+// Maps the file if it starts with CBP_BRANCH_MAGIC. Returns FAILURE for
+// anything else so the caller falls back to the gzip reader.
+
+bool CBP_TRACER::MapBranchFile(char *traceFileName){
+  struct stat st;
+  int fd;
+
+  branchOnly=false;
+  branchMap=NULL;
+  branchMapLen=0;
+  branchHeader=NULL;
+  branchRecords=NULL;
+  nextBranch=0;
+  branchBase=0;
+
+  if ((fd = open(traceFileName, O_RDONLY)) < 0){
+    return FAILURE;
+  }
+  if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(CBP_BRANCH_HEADER))){
+    close(fd);
+    return FAILURE;
+  }
+
+  branchMapLen = st.st_size;
+  branchMap = mmap(NULL, branchMapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (branchMap == MAP_FAILED){
+    return FAILURE;
+  }
+
+  branchHeader = (CBP_BRANCH_HEADER *)branchMap;
+  if (memcmp(branchHeader->magic, CBP_BRANCH_MAGIC, sizeof(branchHeader->magic)) != 0){
+    munmap(branchMap, branchMapLen);
+    return FAILURE;
+  }
+
+  if (branchMapLen != sizeof(CBP_BRANCH_HEADER) + 
+      branchHeader->numCondBranch * sizeof(CBP_BRANCH_RECORD)){
+    printf("Truncated branch file %s. Dying\n", traceFileName);
+    exit(-1);
   }
 
+  madvise(branchMap, branchMapLen, MADV_SEQUENTIAL);
+  branchRecords = (CBP_BRANCH_RECORD *)(branchHeader + 1);
+  branchOnly = true;
+
+  return SUCCESS;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Moves any partial record to the front of the block and tops the block
+// up with the next chunk of decompressed trace. Returns FAILURE once no
+// complete record is left.
+
+bool CBP_TRACER::FillBlock(){
+  UINT32 left = blockLen - blockPos;
+  int    got;
+
+  memmove(block, block + blockPos, left);
+  blockLen = left;
+  blockPos = 0;
+
+  while (blockLen < CBP_TRACE_BLOCK_BYTES){
+    got = gzread(traceFile, block + blockLen, CBP_TRACE_BLOCK_BYTES - blockLen);
+    if (got > 0){
+      blockLen += got;
+      continue;
+    }
+
+    // A truncated or corrupt trace must not pass for a short one
+    int err;
+    const char *msg = gzerror(traceFile, &err);
+    if (got < 0 || (err != Z_OK && err != Z_STREAM_END) || !gzeof(traceFile)){
+      printf("Error reading trace file: %s. Dying\n", msg);
+      exit(-1);
+    }
+    break;
+  }
+
+  return (blockLen >= CBP_TRACE_RECORD_BYTES) ? SUCCESS : FAILURE;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+void CBP_TRACER::DecodeRecord(CBP_TRACE_RECORD *rec){
+  unsigned char *p = block + blockPos;
+
+  memcpy(&rec->PC, p, 4);
+  memcpy(&rec->branchTarget, p + 4, 4);
+  rec->opType = (OpType)p[8];
+  rec->branchTaken = p[9];
+  blockPos += CBP_TRACE_RECORD_BYTES;
+
   // sanity check
   assert(rec->opType < OPTYPE_MAX);
 
@@ -56,6 +173,76 @@ bool  CBP_TRACER::GetNextRecord(CBP_TRACE_RECORD *rec){
   if(rec->opType == OPTYPE_BRANCH_COND){
     numCondBranch++;
   }
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Only conditional branches are stored in a branch file; the instructions
+// in between are accounted for from the gap count, and whatever follows
+// the last branch is added once the file is exhausted (see
+// BranchWithinLimit).
+
+void CBP_TRACER::DecodeBranch(CBP_TRACE_RECORD *rec){
+  CBP_BRANCH_RECORD *br = &branchRecords[nextBranch++];
+
+  rec->PC = br->PC;
+  rec->branchTarget = br->branchTarget;
+  rec->opType = OPTYPE_BRANCH_COND;
+  rec->branchTaken = (br->info & CBP_BRANCH_TAKEN_BIT) != 0;
+
+  branchBase += br->info & CBP_BRANCH_GAP_MASK;
+  numInst = branchBase;
+  numCondBranch++;
+  CheckHeartBeat();
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// The next conditional branch of a branch file exists and does not lie
+// beyond the instruction limit. If it does not, the non-branch
+// instructions before it (or at the end of the trace) are consumed up to
+// the limit.
+bool CBP_TRACER::BranchWithinLimit(){
+  UINT64 next;
+
+  if (nextBranch < branchHeader->numCondBranch){
+    next = branchBase + (branchRecords[nextBranch].info & CBP_BRANCH_GAP_MASK);
+    if (next <= instLimit){
+      return true;
+    }
+    next--;
+  } else {
+    next = branchHeader->numInst;
+  }
+
+  numInst = (next < instLimit) ? next : instLimit;
+  if (numInst < branchBase){
+    numInst = branchBase;
+  }
+  return false;
+}
+
+bool  CBP_TRACER::GetNextRecord(CBP_TRACE_RECORD *rec){
+
+  if (branchOnly){
+    if (!BranchWithinLimit()){
+      return FAILURE;
+    }
+    DecodeBranch(rec);
+    return SUCCESS;
+  }
+
+  if (numInst >= instLimit){
+    return FAILURE;
+  }
+
+  if((blockLen - blockPos < CBP_TRACE_RECORD_BYTES) && !FillBlock()){
+    return FAILURE; 
+  }
+
+  DecodeRecord(rec);
 
   return SUCCESS; 
 }
@@ -63,11 +250,50 @@ bool  CBP_TRACER::GetNextRecord(CBP_TRACE_RECORD *rec){
 /////////////////////////////////////////
 /////////////////////////////////////////
 
+// Decodes up to maxRecords records into the given array and returns how
+// many were produced; 0 means the trace is exhausted.
+
+UINT32 CBP_TRACER::GetNextBatch(CBP_TRACE_RECORD *recs, UINT32 maxRecords){
+  UINT32 n = 0;
+  UINT32 avail;
+
+  if (branchOnly){
+    while ((n < maxRecords) && BranchWithinLimit()){
+      DecodeBranch(&recs[n++]);
+    }
+    return n;
+  }
+
+  while ((n < maxRecords) && (numInst < instLimit)){
+    avail = (blockLen - blockPos) / CBP_TRACE_RECORD_BYTES;
+    if (avail == 0){
+      if (!FillBlock()){
+        break;
+      }
+      continue;
+    }
+    if (avail > maxRecords - n){
+      avail = maxRecords - n;
+    }
+    if (avail > instLimit - numInst){
+      avail = instLimit - numInst;
+    }
+    while (avail--){
+      DecodeRecord(&recs[n++]);
+    }
+  }
+
+  return n;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
 void CBP_TRACER::CheckHeartBeat(){
   UINT64 dotInterval=1000000;
   UINT64 lineInterval=30*dotInterval;
 
-  if(numInst-lastHeartBeat >= dotInterval){
+  if(heartBeat && (numInst-lastHeartBeat >= dotInterval)){
     printf("."); 
     fflush(stdout);
 
@@ -1,6 +1,7 @@
 #ifndef _TRACER_H_
 #define _TRACER_H_
 
+#include <zlib.h>
 #include "utils.h"
 
 /////////////////////////////////////////
@@ -38,27 +39,92 @@ class CBP_TRACE_RECORD{
 };
 
 
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// On-disk record: PC (4), branchTarget (4), opType (1), branchTaken (1)
+#define CBP_TRACE_RECORD_BYTES  10
+
+// Decompressed bytes pulled from the trace per refill, and the number of
+// records handed out per GetNextBatch call by the harness
+#define CBP_TRACE_BLOCK_BYTES   (1 << 20)
+#define CBP_TRACE_BATCH_SIZE    4096
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Pre-decoded branch file written by tracecvt: a header followed by one
+// record per conditional branch. Replaying it needs no decompression and
+// still reproduces the exact instruction count of the original trace.
+
+#define CBP_BRANCH_MAGIC        "CBPBR001"
+#define CBP_BRANCH_TAKEN_BIT    0x80000000  // in CBP_BRANCH_RECORD::info
+#define CBP_BRANCH_GAP_MASK     0x7fffffff  // in CBP_BRANCH_RECORD::info
+
+class CBP_BRANCH_HEADER{
+  public:
+  char     magic[8];
+  UINT64   numInst;        // instructions in the original trace
+  UINT64   numCondBranch;  // records that follow the header
+};
+
+class CBP_BRANCH_RECORD{
+  public:
+  UINT32   PC;
+  UINT32   branchTarget;
+  UINT32   info;           // taken bit | instructions since the previous
+                           // conditional branch, this one included
+};
+
 /////////////////////////////////////////
 /////////////////////////////////////////
 
 class CBP_TRACER{
  private:
-  FILE *traceFile;
+  gzFile traceFile;
+
+  unsigned char *block;  // decompressed trace bytes
+  UINT32 blockLen;       // valid bytes in block
+  UINT32 blockPos;       // next undecoded byte in block
+
+  bool   branchOnly;     // replaying a mapped branch file
+  void  *branchMap;
+  size_t branchMapLen;
+  CBP_BRANCH_HEADER *branchHeader;
+  CBP_BRANCH_RECORD *branchRecords;
+  UINT64 nextBranch;
+  UINT64 branchBase;     // instructions up to and including the last branch
 
   UINT64 numInst;        
   UINT64 numCondBranch;
 
+  UINT64 instLimit;      // stop handing out records past this instruction
+
   UINT64 lastHeartBeat;
+  bool   heartBeat;      // print progress dots
 
  public:
   CBP_TRACER(char *traceFileName);
+  ~CBP_TRACER();
 
   bool   GetNextRecord(CBP_TRACE_RECORD *record);  
+  UINT32 GetNextBatch(CBP_TRACE_RECORD *records, UINT32 maxRecords);
   UINT64 GetNumInst(){ return numInst; }
   UINT64 GetNumCondBranch(){ return numCondBranch; }
+  bool   IsBranchOnly(){ return branchOnly; }
+  void   SetHeartBeat(bool enable){ heartBeat = enable; }
+
+  // Make GetNextRecord/GetNextBatch report the end of the trace once
+  // `limit` instructions have been consumed; raising it again resumes
+  void   SetInstLimit(UINT64 limit){ instLimit = limit; }
 
  private:
+  bool   MapBranchFile(char *traceFileName);
+  bool   FillBlock();
+  void   DecodeRecord(CBP_TRACE_RECORD *rec);
+  void   DecodeBranch(CBP_TRACE_RECORD *rec);
   void   CheckHeartBeat();
+  bool   BranchWithinLimit();
 };
 
 
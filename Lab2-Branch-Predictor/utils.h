@@ -21,8 +21,11 @@
 
 using namespace std;
 
+#define UINT16      unsigned short
 #define UINT32      unsigned int
 #define INT32       int
+#define INT8        signed char
+#define UINT8       unsigned char
 #define UINT64      unsigned long long
 #define COUNTER     unsigned long long
 
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 #include "instr.h"
 
@@ -47,34 +48,358 @@ void print_all_instr(instruction_trace_t* trace, int sim_num_insn) {
    }
 }
 
+//appends a chunk to the directory of the trace, doubling it when full
+static void add_chunk(instruction_trace_t* trace, instruction_trace_t* chunk) {
+
+  if (trace->num_chunks == trace->max_chunks) {
+     trace->max_chunks = trace->max_chunks ? 2 * trace->max_chunks : 16;
+     trace->chunks = realloc(trace->chunks, trace->max_chunks * sizeof(instruction_trace_t*));
+     assert(trace->chunks != NULL);
+  }
+  trace->chunks[trace->num_chunks++] = chunk;
+}
+
+//the directory of the trace, built from the next list the first time it is needed
+static instruction_trace_t** trace_chunks(instruction_trace_t* trace) {
+
+  if (trace->chunks == NULL) {
+     instruction_trace_t* chunk;
+     for (chunk = trace; chunk != NULL; chunk = chunk->next)
+        add_chunk(trace, chunk);
+  }
+  return trace->chunks;
+}
+
 //inserts the instruction into the trace
 void put_instr(instruction_trace_t* trace, instruction_t* instr) {
 
-  while ((trace->size == INSTR_TRACE_SIZE) && (trace->next != NULL)) {
-    trace = trace->next;
-  }
+  instruction_trace_t* last = trace_chunks(trace)[trace->num_chunks - 1];
   
-  if (trace->size == INSTR_TRACE_SIZE) {
+  if (last->size == INSTR_TRACE_SIZE) {
       
-     trace->next = malloc(sizeof(instruction_trace_t));
-     assert(trace->next != NULL);
-     //printf("trace=%p\n", trace);
-     trace = trace->next;
-     memset(trace, 0, sizeof(instruction_trace_t));
+     last->next = malloc(sizeof(instruction_trace_t));
+     assert(last->next != NULL);
+     last = last->next;
+     memset(last, 0, sizeof(instruction_trace_t));
+     add_chunk(trace, last);
   }
-  trace->table[trace->size++] = *instr;
+  last->table[last->size++] = *instr;
 } 
 
 //gets the instruction at the index, from the trace
 instruction_t* get_instr(instruction_trace_t* trace, int index) {
 
-  while (index >= INSTR_TRACE_SIZE) {
-     index -= INSTR_TRACE_SIZE;
-     trace = trace->next;
+  instruction_trace_t** chunks = trace_chunks(trace);
+
+  assert(index / INSTR_TRACE_SIZE < trace->num_chunks);
+  return &chunks[index / INSTR_TRACE_SIZE]->table[index % INSTR_TRACE_SIZE];
+}
+
+
+//copies every chunk of the trace, without the Tomasulo timing state
+instruction_trace_t* copy_instr_trace(instruction_trace_t* trace) {
+
+  instruction_trace_t* head = NULL;
+  instruction_trace_t** tail = &head;
+
+  for (; trace != NULL; trace = trace->next) {
+     *tail = malloc(sizeof(instruction_trace_t));
+     assert(*tail != NULL);
+     memcpy(*tail, trace, sizeof(instruction_trace_t));
+     (*tail)->next = NULL;
+     (*tail)->chunks = NULL;
+     (*tail)->num_chunks = (*tail)->max_chunks = 0;
+     tail = &(*tail)->next;
+  }
+
+  reset_instr_trace(head);
+  return head;
+}
+
+//clears the Tomasulo timing state (Q, waiters, done_cycle and tom_*_cycle) of every instruction
+void reset_instr_trace(instruction_trace_t* trace) {
+
+  int i;
+  for (; trace != NULL; trace = trace->next) {
+     for (i = 0; i < trace->size; i++) {
+        instruction_t* instr = &trace->table[i];
+        instr->Q[0] = instr->Q[1] = instr->Q[2] = NULL;
+        instr->waiters = NULL;
+        instr->next_waiter[0] = instr->next_waiter[1] = instr->next_waiter[2] = NULL;
+        instr->rs_slot = -1;
+        instr->tom_dispatch_cycle = 0;
+        instr->tom_issue_cycle = 0;
+        instr->tom_execute_cycle = 0;
+        instr->tom_cdb_cycle = 0;
+        instr->tom_commit_cycle = 0;
+        instr->done_cycle = 0;
+        instr->mem_latency = 0;
+     }
+  }
+}
+
+//frees every chunk of the trace
+void free_instr_trace(instruction_trace_t* trace) {
+
+  while (trace != NULL) {
+     instruction_trace_t* next = trace->next;
+     free(trace->chunks);
+     free(trace);
+     trace = next;
+  }
+}
+
+//prints the instructions first <= i < end of the ring as print_all_instr does; index 0,
+//which is not an instruction, prints the table header instead
+void print_ring_instr(instruction_ring_t* ring, int first, int end) {
+
+  int index;
+  for (index = first; index < end; index++) {
+     if (index == 0)
+        fprintf(stdout, "TOMASULO TABLE\n");
+     else
+        print_tom_instr(ring_get_instr(ring, index));
+  }
+}
+
+//allocates a ring of num_chunks chunks holding the placeholder instruction 0
+instruction_ring_t* new_instr_ring(int num_chunks) {
+
+  int i;
+  instruction_ring_t* ring = malloc(sizeof(instruction_ring_t));
+  assert(ring != NULL);
+
+  ring->num_chunks = num_chunks;
+  ring->chunk = malloc(num_chunks * sizeof(instruction_trace_t*));
+  assert(ring->chunk != NULL);
+  for (i = 0; i < num_chunks; i++) {
+     ring->chunk[i] = malloc(sizeof(instruction_trace_t));
+     assert(ring->chunk[i] != NULL);
+  }
+
+  //skip the first entry, as sim-safe does for the trace
+  memset(&ring->chunk[0]->table[0], 0, sizeof(instruction_t));
+  ring->first = 0;
+  ring->end = 1;
+  return ring;
+}
+
+//appends the instruction to the ring, which must not be full
+void ring_put_instr(instruction_ring_t* ring, instruction_t* instr) {
+
+  assert(!ring_full(ring));
+  *ring_get_instr(ring, ring->end++) = *instr;
+}
+
+//gets the instruction at the index, which the ring must hold
+instruction_t* ring_get_instr(instruction_ring_t* ring, int index) {
+
+  return &ring->chunk[(index / INSTR_TRACE_SIZE) % ring->num_chunks]->table[index % INSTR_TRACE_SIZE];
+}
+
+//true when the next ring_put_instr needs a chunk that is still held
+int ring_full(instruction_ring_t* ring) {
+
+  return ring->end == ring->first + ring->num_chunks * INSTR_TRACE_SIZE;
+}
+
+//drops the oldest chunk so it can be reused
+void ring_retire_chunk(instruction_ring_t* ring) {
+
+  assert(ring->first + INSTR_TRACE_SIZE <= ring->end);
+  ring->first += INSTR_TRACE_SIZE;
+}
+
+//doubles the number of chunks, keeping every instruction held
+void ring_grow(instruction_ring_t* ring) {
+
+  int i, n;
+  int num_chunks = 2 * ring->num_chunks;
+  instruction_trace_t** chunk = malloc(num_chunks * sizeof(instruction_trace_t*));
+  assert(chunk != NULL);
 
-     assert(trace != NULL);
+  //chunk n of the stream moves from slot n % num_chunks/2 to n % num_chunks
+  for (i = 0; i < ring->num_chunks; i++) {
+     n = ring->first / INSTR_TRACE_SIZE + i;
+     chunk[n % num_chunks] = ring->chunk[n % ring->num_chunks];
   }
+  for (i = 0; i < ring->num_chunks; i++) {
+     n = ring->first / INSTR_TRACE_SIZE + ring->num_chunks + i;
+     chunk[n % num_chunks] = malloc(sizeof(instruction_trace_t));
+     assert(chunk[n % num_chunks] != NULL);
+  }
+
+  free(ring->chunk);
+  ring->chunk = chunk;
+  ring->num_chunks = num_chunks;
+}
+
+//frees the ring and its chunks
+void free_instr_ring(instruction_ring_t* ring) {
+
+  int i;
+  for (i = 0; i < ring->num_chunks; i++)
+     free(ring->chunk[i]);
+  free(ring->chunk);
+  free(ring);
+}
+
+/* The pipeline trace starts with PIPETRACE_MAGIC. Each instruction is then a run of
+ * LEB128 varints: the index and PC as deltas from the previous instruction, the two
+ * words of its encoding, its effective address as a delta from the previous load or
+ * store (loads and stores only), its dispatch cycle as a delta from the previous
+ * one, and its issue, execute, CDB, commit and done cycles as offsets from its
+ * dispatch cycle (0 when the stage was never reached). Signed deltas are zigzag
+ * encoded, so a typical instruction takes 10-15 bytes. */
+#define PIPETRACE_MAGIC "TOMPIPE1"
+#define PIPETRACE_MAX_RECORD 64
+
+static unsigned int zigzag(int value) {
+  return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+static int unzigzag(unsigned int value) {
+  return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+static void pipetrace_flush(pipetrace_t* pt) {
+
+  if (pt->pos && fwrite(pt->buf, 1, pt->pos, pt->fd) != (size_t)pt->pos)
+     fatal("could not write the pipeline trace");
+  pt->pos = 0;
+}
+
+static void put_varint(pipetrace_t* pt, unsigned int value) {
+
+  while (value >= 0x80) {
+     pt->buf[pt->pos++] = (value & 0x7f) | 0x80;
+     value >>= 7;
+  }
+  pt->buf[pt->pos++] = value;
+}
+
+static unsigned int get_varint(pipetrace_t* pt) {
+
+  unsigned int value = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+     if (pt->pos == pt->len || shift > 28)
+        fatal("truncated or corrupt pipeline trace");
+     byte = pt->buf[pt->pos++];
+     value |= (unsigned int)(byte & 0x7f) << shift;
+     shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+//a stage's cycle as an offset from the dispatch cycle, 0 if it was never reached
+static unsigned int stage_offset(int cycle, int dispatch) {
+  return cycle ? zigzag(cycle - dispatch) + 1 : 0;
+}
 
-  return &trace->table[index];
+static int stage_cycle(unsigned int offset, int dispatch) {
+  return offset ? dispatch + unzigzag(offset - 1) : 0;
 }
 
+//opens a pipeline trace to write ("w") or read ("r"); fatal if the file cannot be
+//opened or, when reading, is not a pipeline trace
+pipetrace_t* pipetrace_open(char* fname, char* mode) {
+
+  char magic[sizeof(PIPETRACE_MAGIC) - 1];
+  pipetrace_t* pt = calloc(1, sizeof(pipetrace_t));
+  assert(pt != NULL);
+
+  pt->writing = (mode[0] == 'w');
+  pt->fd = fopen(fname, pt->writing ? "wb" : "rb");
+  if (!pt->fd)
+     fatal("cannot open pipeline trace `%s'", fname);
+
+  if (pt->writing) {
+     memcpy(pt->buf, PIPETRACE_MAGIC, sizeof(magic));
+     pt->pos = sizeof(magic);
+  }
+  else if (fread(magic, 1, sizeof(magic), pt->fd) != sizeof(magic)
+           || memcmp(magic, PIPETRACE_MAGIC, sizeof(magic)))
+     fatal("`%s' is not a pipeline trace", fname);
+
+  return pt;
+}
+
+//appends the instruction and its timestamps to the trace, through its buffer
+void pipetrace_write(pipetrace_t* pt, instruction_t* instr) {
+
+  int dispatch = instr->tom_dispatch_cycle;
+
+  if (pt->pos > PIPETRACE_BUF_SIZE - PIPETRACE_MAX_RECORD)
+     pipetrace_flush(pt);
+
+  put_varint(pt, zigzag(instr->index - pt->last_index));
+  put_varint(pt, zigzag((int)(instr->pc - pt->last_pc)));
+  put_varint(pt, instr->inst.a);
+  put_varint(pt, instr->inst.b);
+  if (MD_OP_FLAGS(instr->op) & F_MEM) {
+     put_varint(pt, zigzag((int)(instr->mem_addr - pt->last_mem_addr)));
+     pt->last_mem_addr = instr->mem_addr;
+  }
+  put_varint(pt, zigzag(dispatch - pt->last_dispatch));
+  put_varint(pt, stage_offset(instr->tom_issue_cycle, dispatch));
+  put_varint(pt, stage_offset(instr->tom_execute_cycle, dispatch));
+  put_varint(pt, stage_offset(instr->tom_cdb_cycle, dispatch));
+  put_varint(pt, stage_offset(instr->tom_commit_cycle, dispatch));
+  put_varint(pt, stage_offset(instr->done_cycle, dispatch));
+
+  pt->last_index = instr->index;
+  pt->last_pc = instr->pc;
+  pt->last_dispatch = dispatch;
+}
+
+//reads the next instruction of the trace into instr (index, inst, op, pc, mem_addr,
+//tom_*_cycle and done_cycle); returns false at the end of the trace
+int pipetrace_read(pipetrace_t* pt, instruction_t* instr) {
+
+  int dispatch;
+
+  if (pt->len - pt->pos < PIPETRACE_MAX_RECORD) {
+     memmove(pt->buf, pt->buf + pt->pos, pt->len - pt->pos);
+     pt->len -= pt->pos;
+     pt->pos = 0;
+     pt->len += fread(pt->buf + pt->len, 1, PIPETRACE_BUF_SIZE - pt->len, pt->fd);
+  }
+  if (pt->pos == pt->len)
+     return false;
+
+  memset(instr, 0, sizeof(instruction_t));
+  instr->index = pt->last_index + unzigzag(get_varint(pt));
+  instr->pc = pt->last_pc + unzigzag(get_varint(pt));
+  instr->inst.a = get_varint(pt);
+  instr->inst.b = get_varint(pt);
+  MD_SET_OPCODE(instr->op, instr->inst);
+  if (MD_OP_FLAGS(instr->op) & F_MEM) {
+     instr->mem_addr = pt->last_mem_addr + unzigzag(get_varint(pt));
+     pt->last_mem_addr = instr->mem_addr;
+  }
+  dispatch = pt->last_dispatch + unzigzag(get_varint(pt));
+  instr->tom_dispatch_cycle = dispatch;
+  instr->tom_issue_cycle = stage_cycle(get_varint(pt), dispatch);
+  instr->tom_execute_cycle = stage_cycle(get_varint(pt), dispatch);
+  instr->tom_cdb_cycle = stage_cycle(get_varint(pt), dispatch);
+  instr->tom_commit_cycle = stage_cycle(get_varint(pt), dispatch);
+  instr->done_cycle = stage_cycle(get_varint(pt), dispatch);
+  instr->rs_slot = -1;
+
+  pt->last_index = instr->index;
+  pt->last_pc = instr->pc;
+  pt->last_dispatch = dispatch;
+  return true;
+}
+
+//flushes the trace when writing, closes it and frees it
+void pipetrace_close(pipetrace_t* pt) {
+
+  if (pt->writing)
+     pipetrace_flush(pt);
+  if (fclose(pt->fd))
+     fatal("could not write the pipeline trace");
+  free(pt);
+}
@@ -2,6 +2,8 @@
 #ifndef INSTR_H
 #define INSTR_H
 
+#include <stdio.h>
+
 #include "machine.h"
 
 //data structure representing each instruction
@@ -14,16 +16,34 @@ typedef struct my_instruction
   int r_in[3]; //input registers
   enum md_opcode op; //opcode
   md_addr_t pc; //program counter the instruction executes at
+  md_addr_t next_pc; //program counter of the instruction executed after it
+  md_addr_t mem_addr; //effective address of a load or store
 
   //the equivalents of Qj, Qk; these are pointers to the instructions producing the results
   // for the input registers of this instruction
   struct my_instruction * Q[3]; 
 
+  //instructions waiting in reservation stations for this one's result; each waiter
+  //continues the list through next_waiter[j] of the first Q[j] that points here
+  struct my_instruction * waiters;
+  struct my_instruction * next_waiter[3];
+
+  //position in the age-ordered reservation stations of its class, -1 once it has left them
+  int rs_slot;
+
   //Specify the cycle an instruction **entered** this stage
   int tom_dispatch_cycle;  //dispatch
   int tom_issue_cycle;     //issue
   int tom_execute_cycle;   //execute
   int tom_cdb_cycle;       //writeback via Common Data Bus (CDB)
+  int tom_commit_cycle;    //commit from the reorder buffer, when the machine has one
+
+  //cycle from which the instruction is complete: its CDB broadcast, a store leaving its FU,
+  //or a branch resolving; 0 until it is known
+  int done_cycle;
+
+  //cycles a load spends in memory once issued from the load/store queue
+  int mem_latency;
 
 }instruction_t;
 
@@ -34,15 +54,98 @@ typedef struct my_instruction_list
   instruction_t table[INSTR_TRACE_SIZE];
   int size;
   struct my_instruction_list* next;
+
+  //directory of every chunk of the list, kept in the first one so that instruction i is
+  //found in chunks[i / INSTR_TRACE_SIZE] without walking next; built on first use
+  struct my_instruction_list** chunks;
+  int num_chunks;
+  int max_chunks;
 }instruction_trace_t;
 
+//a bounded window of the instruction stream, for running the timing model alongside the
+//functional simulator: instruction i, for first <= i < end, is in chunk[(i / INSTR_TRACE_SIZE) % num_chunks]
+typedef struct my_instruction_ring
+{
+  instruction_trace_t** chunk;
+  int num_chunks;
+  int first; //oldest instruction held, always at the start of a chunk
+  int end;   //one past the newest instruction
+}instruction_ring_t;
+
+//a binary pipeline trace: per instruction, its index, PC, encoding, effective address and
+//Tomasulo timestamps, as varint deltas from the previous instruction (see instr.c)
+#define PIPETRACE_BUF_SIZE 65536
+
+typedef struct my_pipetrace
+{
+  FILE* fd;
+  int writing;
+  unsigned char buf[PIPETRACE_BUF_SIZE];
+  int pos; //next byte to write or read
+  int len; //bytes held, when reading
+
+  //the fields the next record is encoded against
+  int last_index;
+  md_addr_t last_pc;
+  md_addr_t last_mem_addr;
+  int last_dispatch;
+}pipetrace_t;
+
+//opens a pipeline trace to write ("w") or read ("r"); fatal if the file cannot be
+//opened or, when reading, is not a pipeline trace
+extern pipetrace_t* pipetrace_open(char* fname, char* mode);
+
+//appends the instruction and its timestamps to the trace, through its buffer
+extern void pipetrace_write(pipetrace_t* pt, instruction_t* instr);
+
+//reads the next instruction of the trace into instr (index, inst, op, pc, mem_addr,
+//tom_*_cycle and done_cycle); returns false at the end of the trace
+extern int pipetrace_read(pipetrace_t* pt, instruction_t* instr);
+
+//flushes the trace when writing, closes it and frees it
+extern void pipetrace_close(pipetrace_t* pt);
+
 //prints all the instructions inside the given trace
 extern void print_all_instr(instruction_trace_t* table, int sim_num_insn);
 
+//prints the instructions first <= i < end of the ring as print_all_instr does; index 0,
+//which is not an instruction, prints the table header instead
+extern void print_ring_instr(instruction_ring_t* ring, int first, int end);
+
 //inserts the instruction into the trace
 extern void put_instr(instruction_trace_t* trace, instruction_t* instr);
 
 //gets the instruction at the index, from the trace
 extern instruction_t* get_instr(instruction_trace_t* trace, int index);
 
+//copies every chunk of the trace, without the Tomasulo timing state
+extern instruction_trace_t* copy_instr_trace(instruction_trace_t* trace);
+
+//clears the Tomasulo timing state (Q, waiters, done_cycle and tom_*_cycle) of every instruction
+extern void reset_instr_trace(instruction_trace_t* trace);
+
+//frees every chunk of the trace
+extern void free_instr_trace(instruction_trace_t* trace);
+
+//allocates a ring of num_chunks chunks holding the placeholder instruction 0
+extern instruction_ring_t* new_instr_ring(int num_chunks);
+
+//appends the instruction to the ring, which must not be full
+extern void ring_put_instr(instruction_ring_t* ring, instruction_t* instr);
+
+//gets the instruction at the index, which the ring must hold
+extern instruction_t* ring_get_instr(instruction_ring_t* ring, int index);
+
+//true when the next ring_put_instr needs a chunk that is still held
+extern int ring_full(instruction_ring_t* ring);
+
+//drops the oldest chunk so it can be reused
+extern void ring_retire_chunk(instruction_ring_t* ring);
+
+//doubles the number of chunks, keeping every instruction held
+extern void ring_grow(instruction_ring_t* ring);
+
+//frees the ring and its chunks
+extern void free_instr_ring(instruction_ring_t* ring);
+
 #endif
@@ -0,0 +1,111 @@
+/* instrbench.c - times capturing and fetching a long instruction trace
+ *
+ * Builds a trace of the given number of instructions with put_instr and
+ * fetches every one of them in order with get_instr, as sim-safe and
+ * runTomasulo do. With "list", the same is timed with the linked-list walk
+ * put_instr and get_instr did before the trace kept a chunk directory, whose
+ * cost grows with the index of the instruction.
+ *
+ * usage: instrbench <instructions> [list]
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "instr.h"
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+//put_instr as it was: walks from the head to the last chunk
+static void
+list_put_instr(instruction_trace_t* trace, instruction_t* instr)
+{
+  while ((trace->size == INSTR_TRACE_SIZE) && (trace->next != NULL))
+    trace = trace->next;
+
+  if (trace->size == INSTR_TRACE_SIZE)
+    {
+      trace->next = malloc(sizeof(instruction_trace_t));
+      assert(trace->next != NULL);
+      trace = trace->next;
+      memset(trace, 0, sizeof(instruction_trace_t));
+    }
+  trace->table[trace->size++] = *instr;
+}
+
+//get_instr as it was: walks from the head to the chunk of the index
+static instruction_t*
+list_get_instr(instruction_trace_t* trace, int index)
+{
+  while (index >= INSTR_TRACE_SIZE)
+    {
+      index -= INSTR_TRACE_SIZE;
+      trace = trace->next;
+      assert(trace != NULL);
+    }
+  return &trace->table[index];
+}
+
+int
+main(int argc, char** argv)
+{
+  int n, i, list;
+  long long sum = 0;
+  double start, put_time, get_time;
+  instruction_t instr;
+  instruction_trace_t* trace;
+
+  if (argc < 2 || (n = atoi(argv[1])) <= 0)
+    {
+      fprintf(stderr, "usage: %s <instructions> [list]\n", argv[0]);
+      exit(1);
+    }
+  list = argc > 2 && !strcmp(argv[2], "list");
+
+  trace = malloc(sizeof(instruction_trace_t));
+  assert(trace != NULL);
+  memset(trace, 0, sizeof(instruction_trace_t));
+  //skip the first entry, as sim-safe does
+  trace->size++;
+
+  memset(&instr, 0, sizeof(instruction_t));
+  start = now();
+  for (i = 1; i <= n; i++)
+    {
+      instr.index = i;
+      if (list)
+	list_put_instr(trace, &instr);
+      else
+	put_instr(trace, &instr);
+    }
+  put_time = now() - start;
+
+  start = now();
+  for (i = 1; i <= n; i++)
+    sum += list ? list_get_instr(trace, i)->index : get_instr(trace, i)->index;
+  get_time = now() - start;
+
+  if (sum != (long long)n * (n + 1) / 2)
+    {
+      fprintf(stderr, "instrbench: read back the wrong instructions\n");
+      exit(1);
+    }
+
+  printf("%s: %d instructions (%.0f MB), put %.2f s (%.1f ns each), "
+	 "get %.2f s (%.1f ns each)\n",
+	 list ? "linked list" : "chunk directory", n,
+	 (double)n * sizeof(instruction_t) / (1 << 20),
+	 put_time, put_time * 1e9 / n, get_time, get_time * 1e9 / n);
+
+  free_instr_trace(trace);
+  return 0;
+}
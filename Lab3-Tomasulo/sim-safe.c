@@ -66,6 +66,7 @@
 #include "sim.h"
 
 #include "instr.h"
+#include "tomasulo.h"
 #include "decode.def"
 #include <assert.h>
 
@@ -88,11 +89,61 @@ static counter_t sim_num_refs = 0;
 
 /* ECE552 BEGIN */
 static counter_t sim_num_tom_cycles = 0;
+static tomasulo_stats_t tom_stats;
 /* ECE552 END */
 
 /* maximum number of inst's to execute */
 static unsigned int max_insts;
 
+/* ECE552 BEGIN */
+/* Tomasulo machine parameters (-tom:*) */
+static tomasulo_config_t tom_config;
+static char *tom_bpred_name;
+
+/* further machines simulated on the same trace (-tom:sweep) */
+#define MAX_TOM_SWEEP 64
+static char *tom_sweep_specs[MAX_TOM_SWEEP];
+static int tom_sweep_nelt = 0;
+static int tom_sweep_threads;
+static tomasulo_config_t tom_sweep_configs[MAX_TOM_SWEEP];
+static counter_t tom_sweep_cycles[MAX_TOM_SWEEP];
+
+/* print every instruction's Tomasulo timestamps (-tom:print) */
+static int tom_print;
+
+/* per-cycle occupancy and stall distributions (-tom:dists) */
+static int tom_dists;
+
+/* binary pipeline trace of every instruction's Tomasulo timestamps
+   (-tom:pipetrace), converted for pipeview.pl by tomptrace */
+static char *tom_pipetrace_fname;
+static pipetrace_t *tom_pipetrace = NULL;
+
+/* sampled simulation (-tom:sample:*): each period fast-forwards
+   tom_sample_ff instructions, only warming the predictor and data cache,
+   then simulates tom_sample_warm instructions in detail before timing the
+   next tom_sample_len; sampling is off while tom_sample_len is 0 */
+static unsigned int tom_sample_ff;
+static unsigned int tom_sample_warm;
+static unsigned int tom_sample_len;
+
+/* instructions of the current period executed so far */
+static counter_t tom_sample_pos = 0;
+
+/* dispatch cycles of the first timed instruction of the window and of the
+   one after the last */
+static counter_t tom_sample_start, tom_sample_stop;
+
+/* windows timed, instructions simulated in detail, and the CPI estimate
+   with its 95% confidence interval, updated after every window; the
+   deviation and interval are NaN until there are two windows */
+static counter_t tom_sample_windows = 0;
+static counter_t tom_sample_detailed = 0;
+static double tom_sample_sum = 0.0, tom_sample_sumsq = 0.0;
+static double tom_sample_cpi = 0.0, tom_sample_stddev = NAN;
+static double tom_sample_ci95 = NAN;
+/* ECE552 END */
+
 /* register simulator-specific options */
 void
 sim_reg_options(struct opt_odb_t *odb)
@@ -110,19 +161,148 @@ sim_reg_options(struct opt_odb_t *odb)
 	       &max_insts, /* default */0,
 	       /* print */TRUE, /* format */NULL);
 
+  /* ECE552 BEGIN */
+  opt_reg_flag(odb, "-tom:print",
+	       "print the Tomasulo timestamps of every instruction",
+	       &tom_print, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-tom:pipetrace",
+		 "write every instruction's Tomasulo timestamps to this binary "
+		 "pipeline trace",
+		 &tom_pipetrace_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_uint(odb, "-tom:sample:len",
+	       "Tomasulo instructions timed per sampled window (0 = simulate all)",
+	       &tom_sample_len, /* default */0,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_uint(odb, "-tom:sample:warm",
+	       "Tomasulo instructions simulated in detail before each window",
+	       &tom_sample_warm, /* default */2000,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_uint(odb, "-tom:sample:ff",
+	       "instructions only executed, warming the Tomasulo predictor and "
+	       "cache, between windows",
+	       &tom_sample_ff, /* default */100000,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_flag(odb, "-tom:dists",
+	       "report per-cycle Tomasulo occupancy and stall distributions",
+	       &tom_dists, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_flag(odb, "-tom:issuefix",
+	       "do not reissue executing instructions to free FUs, as the "
+	       "original submission does",
+	       &tom_config.issue_fix, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:ifq", "Tomasulo instruction fetch queue size",
+	      &tom_config.instr_queue_size, /* default */10,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:rs:int", "Tomasulo INT reservation stations",
+	      &tom_config.reserv_int_size, /* default */4,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:rs:fp", "Tomasulo FP reservation stations",
+	      &tom_config.reserv_fp_size, /* default */2,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:fu:int", "Tomasulo INT functional units",
+	      &tom_config.fu_int_size, /* default */2,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:fu:fp", "Tomasulo FP functional units",
+	      &tom_config.fu_fp_size, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lat:int", "Tomasulo INT functional unit latency",
+	      &tom_config.fu_int_latency, /* default */4,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lat:fp", "Tomasulo FP functional unit latency",
+	      &tom_config.fu_fp_latency, /* default */9,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:cdb", "Tomasulo common data buses",
+	      &tom_config.cdb_size, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:width",
+	      "Tomasulo instructions fetched and dispatched per cycle",
+	      &tom_config.dispatch_width, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:rob",
+	      "Tomasulo reorder buffer entries (0 = no in-order commit)",
+	      &tom_config.rob_size, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-tom:bpred",
+		 "Tomasulo branch predictor (perfect|nottaken|bimod|gshare)",
+		 &tom_bpred_name, /* default */"perfect",
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:mplat",
+	      "Tomasulo cycles from a mispredicted branch resolving to fetching again",
+	      &tom_config.mispredict_penalty, /* default */3,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lsq",
+	      "Tomasulo load/store queue entries (0 = loads and stores use the INT FUs)",
+	      &tom_config.lsq_size, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:mem:ports",
+	      "Tomasulo loads and stores started per cycle from the load/store queue",
+	      &tom_config.mem_ports, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:dl1:sets",
+	      "Tomasulo data cache sets (0 = no cache, accesses take -tom:lat:int)",
+	      &tom_config.dl1_sets, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:dl1:assoc", "Tomasulo data cache associativity",
+	      &tom_config.dl1_assoc, /* default */2,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:dl1:block", "Tomasulo data cache block size in bytes",
+	      &tom_config.dl1_block, /* default */32,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lat:dl1", "Tomasulo data cache hit latency",
+	      &tom_config.dl1_latency, /* default */2,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-tom:lat:mem",
+	      "Tomasulo cycles a data cache miss adds to the hit latency",
+	      &tom_config.mem_latency, /* default */20,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string_list(odb, "-tom:sweep",
+		      "more Tomasulo machines to simulate on the same trace, "
+		      "each as changes to the -tom: options, e.g. rs:int=8,fu:int=4",
+		      tom_sweep_specs, MAX_TOM_SWEEP, &tom_sweep_nelt, NULL,
+		      /* print */TRUE, /* format */NULL, /* accrue */TRUE);
+  opt_reg_int(odb, "-tom:threads",
+	      "threads for -tom:sweep (0 = one per processor)",
+	      &tom_sweep_threads, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+  /* ECE552 END */
 }
 
 /* check simulator-specific option values */
 void
 sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  int i;
+
+  tom_config.bpred = find_tomasulo_bpred(tom_bpred_name);
+  check_tomasulo_config(&tom_config);
+  for (i = 0; i < tom_sweep_nelt; i++)
+    {
+      tom_sweep_configs[i] = tom_config;
+      parse_tomasulo_config(&tom_sweep_configs[i], tom_sweep_specs[i]);
+    }
+  if (tom_sample_len && tom_sweep_nelt > 0)
+    fatal("-tom:sample:len cannot be combined with -tom:sweep");
+  if (tom_sample_len && (tom_print || tom_pipetrace_fname))
+    fatal("-tom:sample:len cannot be combined with -tom:print or "
+	  "-tom:pipetrace");
+  /* ECE552 END */
 }
 
 /* register simulator-specific statistics */
 void
 sim_reg_stats(struct stat_sdb_t *sdb)
 {
+  /* ECE552 BEGIN */
+  int i;
+  char *name, *desc, *formula;
+  /* ECE552 END */
+
   stat_reg_counter(sdb, "sim_num_insn",
 		   "total number of instructions executed",
 		   &sim_num_insn, sim_num_insn, NULL);
@@ -141,6 +321,85 @@ sim_reg_stats(struct stat_sdb_t *sdb)
   stat_reg_counter(sdb, "sim_num_tom_cycles",
 		   "total number of cycles with tomasulo",
 		   &sim_num_tom_cycles, 0, NULL);
+  stat_reg_formula(sdb, "sim_tom_cpi",
+		   "cycles per instruction with tomasulo",
+		   "sim_num_tom_cycles / sim_num_insn", NULL);
+  stat_reg_counter(sdb, "tom_num_branches",
+		   "control instructions fetched by tomasulo",
+		   &tom_stats.branches, 0, NULL);
+  stat_reg_counter(sdb, "tom_num_mispredicts",
+		   "of which the -tom:bpred predictor got the next PC wrong",
+		   &tom_stats.mispredicts, 0, NULL);
+  stat_reg_formula(sdb, "tom_mispredict_rate",
+		   "fraction of tomasulo branches mispredicted",
+		   "tom_num_mispredicts / tom_num_branches", NULL);
+  if (tom_config.lsq_size)
+    {
+      stat_reg_counter(sdb, "tom_num_lsq_loads",
+		       "loads issued from the tomasulo load/store queue",
+		       &tom_stats.loads, 0, NULL);
+      stat_reg_counter(sdb, "tom_num_forwarded",
+		       "of which took their value from an older store",
+		       &tom_stats.forwarded, 0, NULL);
+    }
+  if (tom_config.dl1_sets)
+    {
+      stat_reg_counter(sdb, "tom_dl1_accesses",
+		       "tomasulo data cache accesses",
+		       &tom_stats.dl1_accesses, 0, NULL);
+      stat_reg_counter(sdb, "tom_dl1_misses",
+		       "tomasulo data cache misses",
+		       &tom_stats.dl1_misses, 0, NULL);
+      stat_reg_formula(sdb, "tom_dl1_miss_rate",
+		       "tomasulo data cache miss rate",
+		       "tom_dl1_misses / tom_dl1_accesses", NULL);
+    }
+
+  if (tom_sample_len)
+    {
+      stat_reg_counter(sdb, "tom_sample_windows",
+		       "sampled windows timed with tomasulo",
+		       &tom_sample_windows, 0, NULL);
+      stat_reg_counter(sdb, "tom_sample_detailed_insn",
+		       "instructions simulated in detail, warm-up included",
+		       &tom_sample_detailed, 0, NULL);
+      stat_reg_formula(sdb, "tom_sample_detailed_frac",
+		       "fraction of instructions simulated in detail",
+		       "tom_sample_detailed_insn / sim_num_insn", NULL);
+      stat_reg_double(sdb, "tom_sample_cpi",
+		      "mean tomasulo CPI of the sampled windows",
+		      &tom_sample_cpi, 0.0, NULL);
+      stat_reg_double(sdb, "tom_sample_cpi_stddev",
+		      "standard deviation of the CPI of the sampled windows",
+		      &tom_sample_stddev, NAN, NULL);
+      stat_reg_double(sdb, "tom_sample_cpi_ci95",
+		      "half-width of the 95% confidence interval of tom_sample_cpi",
+		      &tom_sample_ci95, NAN, NULL);
+      stat_reg_formula(sdb, "tom_sample_cpi_error",
+		       "tom_sample_cpi_ci95 relative to tom_sample_cpi",
+		       "tom_sample_cpi_ci95 / tom_sample_cpi", NULL);
+    }
+
+  if (tom_dists)
+    reg_tomasulo_stats(sdb, &tom_config);
+
+  for (i = 0; i < tom_sweep_nelt; i++)
+    {
+      char buf[512];
+
+      sprintf(buf, "tom_sweep%d_cycles", i);
+      name = mystrdup(buf);
+      sprintf(buf, "cycles with tomasulo on %.400s", tom_sweep_specs[i]);
+      stat_reg_counter(sdb, name, mystrdup(buf), &tom_sweep_cycles[i], 0, NULL);
+
+      sprintf(buf, "%s / sim_num_insn", name);
+      formula = mystrdup(buf);
+      sprintf(buf, "cycles per instruction with tomasulo on %.400s",
+	      tom_sweep_specs[i]);
+      desc = mystrdup(buf);
+      sprintf(buf, "tom_sweep%d_cpi", i);
+      stat_reg_formula(sdb, mystrdup(buf), desc, formula, NULL);
+    }
   /* ECE552 END */
 
   ld_reg_stats(sdb);
@@ -289,7 +548,143 @@ sim_uninit(void)
 #define SYSCALL(INST)	sys_syscall(&regs, mem_access, mem, INST, TRUE)
 
 /* ECE552 BEGIN */
-instruction_trace_t* instruction_trace;
+/* the whole trace, captured when machines are swept over it */
+instruction_trace_t* instruction_trace = NULL;
+
+/* otherwise the Tomasulo model runs alongside, fetching from a ring of
+   TOM_RING_CHUNKS chunks that is recycled as the model moves on */
+#define TOM_RING_CHUNKS 4
+instruction_ring_t* instruction_ring = NULL;
+
+/* appends instructions first <= i < end of the ring or trace to the pipeline
+   trace; index 0 is not an instruction */
+static void
+tom_write_pipetrace(int first, int end)
+{
+  int i;
+
+  for (i = first ? first : 1; i < end; i++)
+    pipetrace_write(tom_pipetrace,
+		    instruction_ring
+		    ? ring_get_instr(instruction_ring, i)
+		    : get_instr(instruction_trace, i));
+}
+
+/* notes the dispatch cycles that time a sampled window, if the instructions
+   first <= i < end of the ring hold them */
+static void
+tom_sample_marks(int first, int end)
+{
+  int start = tom_sample_warm + 1, stop = start + tom_sample_len;
+
+  if (first <= start && start < end)
+    tom_sample_start =
+      ring_get_instr(instruction_ring, start)->tom_dispatch_cycle;
+  if (first <= stop && stop < end)
+    tom_sample_stop =
+      ring_get_instr(instruction_ring, stop)->tom_dispatch_cycle;
+}
+
+/* lets the Tomasulo model catch up with the full ring, then frees the chunks
+   it no longer needs; grows the ring if it needs them all */
+static void
+tom_drain_ring(void)
+{
+  int oldest;
+
+  /* the newest instruction may be the last one, which is never fetched */
+  oldest = advanceTomasulo(instruction_ring->end - 1);
+
+  while (instruction_ring->first + INSTR_TRACE_SIZE <= oldest)
+    {
+      if (tom_print)
+	print_ring_instr(instruction_ring, instruction_ring->first,
+			 instruction_ring->first + INSTR_TRACE_SIZE);
+      if (tom_pipetrace)
+	tom_write_pipetrace(instruction_ring->first,
+			    instruction_ring->first + INSTR_TRACE_SIZE);
+      if (tom_sample_len)
+	tom_sample_marks(instruction_ring->first,
+			 instruction_ring->first + INSTR_TRACE_SIZE);
+      ring_retire_chunk(instruction_ring);
+    }
+
+  if (ring_full(instruction_ring))
+    ring_grow(instruction_ring);
+}
+
+/* finishes the detailed run of a sampled window and adds its CPI, from the
+   cycles its timed instructions took to dispatch, to the estimate */
+static void
+tom_sample_window_end(void)
+{
+  tomasulo_stats_t window_stats;
+  double cpi, n, var;
+
+  tom_sample_detailed += instruction_ring->end - 1;
+  finishTomasulo(instruction_ring->end - 1);
+  tom_sample_marks(instruction_ring->first, instruction_ring->end);
+  free_instr_ring(instruction_ring);
+  instruction_ring = NULL;
+
+  tomasuloStats(&window_stats);
+  tom_stats.branches += window_stats.branches;
+  tom_stats.mispredicts += window_stats.mispredicts;
+  tom_stats.loads += window_stats.loads;
+  tom_stats.forwarded += window_stats.forwarded;
+  tom_stats.dl1_accesses += window_stats.dl1_accesses;
+  tom_stats.dl1_misses += window_stats.dl1_misses;
+
+  cpi = (double)(tom_sample_stop - tom_sample_start) / tom_sample_len;
+  tom_sample_sum += cpi;
+  tom_sample_sumsq += cpi * cpi;
+  n = (double)++tom_sample_windows;
+
+  tom_sample_cpi = tom_sample_sum / n;
+  if (n > 1)
+    {
+      var = (tom_sample_sumsq - tom_sample_sum * tom_sample_cpi) / (n - 1);
+      tom_sample_stddev = var > 0 ? sqrt(var) : 0.0;
+      tom_sample_ci95 = 1.96 * tom_sample_stddev / sqrt(n);
+    }
+
+  /* the estimate for the instructions executed so far, should the program
+     exit before -max:inst */
+  sim_num_tom_cycles = (counter_t)(tom_sample_cpi * sim_num_insn + 0.5);
+}
+
+/* takes an executed instruction in sampled simulation: fast-forwarded ones
+   warm the predictor and data cache, the rest make up the window, numbered
+   from 1 in a ring of its own. A window is its warm-up, its timed
+   instructions, one more whose dispatch ends the timing, and the last
+   instruction, which the model never fetches */
+static void
+tom_sample_instr(instruction_t *instr)
+{
+  counter_t window = tom_sample_warm + tom_sample_len + 2;
+
+  if (tom_sample_pos < tom_sample_ff)
+    warmTomasulo(instr);
+  else
+    {
+      if (tom_sample_pos == tom_sample_ff)
+	{
+	  instruction_ring = new_instr_ring(TOM_RING_CHUNKS);
+	  startTomasulo(instruction_ring, &tom_config);
+	}
+
+      instr->index = tom_sample_pos - tom_sample_ff + 1;
+      if (ring_full(instruction_ring))
+	tom_drain_ring();
+      ring_put_instr(instruction_ring, instr);
+
+      if (instr->index == window)
+	tom_sample_window_end();
+    }
+
+  if (++tom_sample_pos == tom_sample_ff + window)
+    tom_sample_pos = 0;
+}
 /* ECE552 END */
 
 /* start simulation, program loaded, processor precise state initialized */
@@ -306,11 +701,24 @@ sim_main(void)
   instruction_t m_instr;
   memset(&m_instr, 0, sizeof(instruction_t));
 
-  instruction_trace = malloc(sizeof(instruction_trace_t));
-  assert(instruction_trace != NULL);
-  memset(instruction_trace, 0, sizeof(instruction_trace_t));
-  //skip the first entry
-  instruction_trace->size++;
+  if (tom_pipetrace_fname)
+    tom_pipetrace = pipetrace_open(tom_pipetrace_fname, "w");
+
+  if (tom_sample_len)
+    startTomasuloWarming(&tom_config);
+  else if (tom_sweep_nelt > 0)
+    {
+      instruction_trace = malloc(sizeof(instruction_trace_t));
+      assert(instruction_trace != NULL);
+      memset(instruction_trace, 0, sizeof(instruction_trace_t));
+      //skip the first entry
+      instruction_trace->size++;
+    }
+  else
+    {
+      instruction_ring = new_instr_ring(TOM_RING_CHUNKS);
+      startTomasulo(instruction_ring, &tom_config);
+    }
   /* ECE552 END */
 
   fprintf(stderr, "sim: ** starting functional simulation **\n");
@@ -374,7 +782,19 @@ sim_main(void)
       }
 
       /* ECE552 BEGIN */
-      put_instr(instruction_trace, &m_instr);
+      m_instr.next_pc = regs.regs_NPC;
+      m_instr.mem_addr = addr;
+
+      if (tom_sample_len)
+	tom_sample_instr(&m_instr);
+      else if (instruction_ring)
+	{
+	  if (ring_full(instruction_ring))
+	    tom_drain_ring();
+	  ring_put_instr(instruction_ring, &m_instr);
+	}
+      else
+	put_instr(instruction_trace, &m_instr);
       /* ECE552 END */
 
       if (fault != md_fault_none)
@@ -416,10 +836,55 @@ sim_main(void)
 
     /* ECE552 BEGIN */
 
-    sim_num_tom_cycles = runTomasulo(instruction_trace);
-  
-    //print_all_instr(instruction_trace, sim_num_insn);
+    if (tom_sample_len)
+      {
+        /* a window cut short by -max:inst is not timed */
+        if (instruction_ring)
+          {
+            finishTomasulo(instruction_ring->end - 1);
+            free_instr_ring(instruction_ring);
+            instruction_ring = NULL;
+          }
+        stopTomasuloWarming();
+        sim_num_tom_cycles = (counter_t)(tom_sample_cpi * sim_num_insn + 0.5);
+      }
+    else if (instruction_ring)
+      {
+        sim_num_tom_cycles = finishTomasulo(sim_num_insn);
+        tomasuloStats(&tom_stats);
+
+        if (tom_print)
+          print_ring_instr(instruction_ring, instruction_ring->first,
+			   instruction_ring->end);
+        if (tom_pipetrace)
+          tom_write_pipetrace(instruction_ring->first, instruction_ring->end);
+
+        free_instr_ring(instruction_ring);
+        instruction_ring = NULL;
+      }
+    else
+      {
+        sim_num_tom_cycles = runTomasulo(instruction_trace, &tom_config);
+        tomasuloStats(&tom_stats);
+
+        if (tom_print)
+          print_all_instr(instruction_trace, sim_num_insn);
+        if (tom_pipetrace)
+          tom_write_pipetrace(1, sim_num_insn + 1);
+
+        fprintf(stderr, "sim: ** sweeping %d Tomasulo machines **\n",
+		tom_sweep_nelt);
+        sweepTomasulo(instruction_trace, tom_sweep_configs, tom_sweep_nelt,
+		      tom_sweep_threads, tom_sweep_cycles);
+
+        free_instr_trace(instruction_trace);
+        instruction_trace = NULL;
+      }
 
-    free(instruction_trace);
+    if (tom_pipetrace)
+      {
+        pipetrace_close(tom_pipetrace);
+        tom_pipetrace = NULL;
+      }
     /* ECE552 END */
 }
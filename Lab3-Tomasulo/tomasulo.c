@@ -5,6 +5,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "host.h"
 #include "misc.h"
@@ -20,18 +23,42 @@
 #include "decode.def"
 
 #include "instr.h"
+#include "tomasulo.h"
 
 /* PARAMETERS OF THE TOMASULO'S ALGORITHM */
 
-#define INSTR_QUEUE_SIZE         10
+/* Set per run from the -tom: options or a sweep configuration. The state
+   below is per thread so that a sweep can run several machines at once. */
+static __thread tomasulo_config_t config;
 
-#define RESERV_INT_SIZE    4
-#define RESERV_FP_SIZE     2
-#define FU_INT_SIZE        2
-#define FU_FP_SIZE         1
+#define INSTR_QUEUE_SIZE   (config.instr_queue_size)
 
-#define FU_INT_LATENCY     4
-#define FU_FP_LATENCY      9
+#define RESERV_INT_SIZE    (config.reserv_int_size)
+#define RESERV_FP_SIZE     (config.reserv_fp_size)
+#define FU_INT_SIZE        (config.fu_int_size)
+#define FU_FP_SIZE         (config.fu_fp_size)
+
+#define FU_INT_LATENCY     (config.fu_int_latency)
+#define FU_FP_LATENCY      (config.fu_fp_latency)
+
+#define CDB_SIZE           (config.cdb_size)
+#define DISPATCH_WIDTH     (config.dispatch_width)
+
+#define ROB_SIZE           (config.rob_size)
+#define MISPREDICT_PENALTY (config.mispredict_penalty)
+
+#define LSQ_SIZE           (config.lsq_size)
+#define MEM_PORTS          (config.mem_ports)
+#define DL1_SETS           (config.dl1_sets)
+#define DL1_ASSOC          (config.dl1_assoc)
+#define DL1_BLOCK          (config.dl1_block)
+#define DL1_LATENCY        (config.dl1_latency)
+#define MEM_LATENCY        (config.mem_latency)
+
+#define ISSUE_FIX          (config.issue_fix)
+
+//cycles a load takes to get its value from an older store in the load/store queue
+#define LSQ_FORWARD_LATENCY 1
 
 /* IDENTIFYING INSTRUCTIONS */
 
@@ -42,6 +69,9 @@
 //conditional branch instruction
 #define IS_COND_CTRL(op) (MD_OP_FLAGS(op) & F_COND)
 
+//any control instruction, whose next PC has to be predicted
+#define IS_CTRL(op) (MD_OP_FLAGS(op) & F_CTRL)
+
 //floating-point computation
 #define IS_FCOMP(op) (MD_OP_FLAGS(op) & F_FCOMP)
 
@@ -77,33 +107,503 @@
 
 /* VARIABLES */
 
-//instruction queue for tomasulo
-static instruction_t* instr_queue[INSTR_QUEUE_SIZE];
+//instruction queue for tomasulo, a ring of INSTR_QUEUE_SIZE entries starting at instr_queue_head
+static __thread instruction_t** instr_queue;
+static __thread int instr_queue_head = 0;
 //number of instructions in the instruction queue
-static int instr_queue_size = 0;
+static __thread int instr_queue_size = 0;
+
+//one class of reservation stations, kept in age order: entry[0] is the oldest instruction and
+//bit p of ready is set while entry[p] has all its operands, so the oldest ready one is a bit scan
+typedef struct reservation_stations
+{
+    instruction_t** entry;
+    int count;                //occupied entries, entry[0..count-1]
+    int size;
+    unsigned long long* ready;
+    int words;
+}reservation_stations_t;
 
 //reservation stations (each reservation station entry contains a pointer to an instruction)
-static instruction_t* reservINT[RESERV_INT_SIZE];
-static instruction_t* reservFP[RESERV_FP_SIZE];
+static __thread reservation_stations_t reservINT;
+static __thread reservation_stations_t reservFP;
+
+//load/store queue, in age order like the reservation stations; with LSQ_SIZE 0 loads
+//and stores go through reservINT and fuINT instead
+static __thread reservation_stations_t lsq;
+
+//data cache: the block held by each way of each set, and when it was last used (0 if empty)
+static __thread md_addr_t* dl1_block;
+static __thread counter_t* dl1_used;
+static __thread counter_t dl1_clock;
 
 //functional units
-static instruction_t* fuINT[FU_INT_SIZE];
-static instruction_t* fuFP[FU_FP_SIZE];
+static __thread instruction_t** fuINT;
+static __thread instruction_t** fuFP;
+
+//common data buses, each broadcasting one result per cycle
+static __thread instruction_t** commonDataBus;
 
-//common data bus
-static instruction_t* commonDataBus = NULL;
+//the functional units and CDBs in use, kept up to date as they fill and empty
+static __thread int fu_int_busy, fu_fp_busy, cdb_busy;
 
 //The map table keeps track of which instruction produces the value for each register
-static instruction_t* map_table[MD_TOTAL_REGS];
+static __thread instruction_t* map_table[MD_TOTAL_REGS];
+
+//reorder buffer, a ring of ROB_SIZE entries in program order starting at rob_head
+static __thread instruction_t** rob;
+static __thread int rob_head = 0;
+static __thread int rob_count = 0;
+
+//state of the run's branch predictor, and the mispredicted branch fetch waits for
+static __thread void* bpred_state;
+static __thread instruction_t* fetch_blocked_by;
+
+static __thread tomasulo_stats_t stats;
+
+//set between startTomasuloWarming and stopTomasuloWarming: runs share the predictor and cache
+static __thread int keep_warm;
+
+/* PER-CYCLE STATISTICS */
+
+//why a stage could not do more in a cycle; a cycle can have several
+enum tom_stall {
+    stall_ifq_full,     //fetch: the IFQ is full
+    stall_mispredict,   //fetch: waiting for a mispredicted branch
+    stall_rob_full,     //dispatch: no reorder buffer entry
+    stall_rs_full,      //dispatch: no reservation station of the head's class
+    stall_lsq_full,     //dispatch: no load/store queue entry
+    stall_fu_busy,      //issue: ready instructions but no free FU of their class
+    stall_operand_wait, //issue: a free FU, but its class only has instructions waiting for operands
+    stall_cdb_conflict, //writeback: finished instructions left without a CDB
+    stall_NUM
+};
+
+static char *stall_str[stall_NUM] = {
+    "ifq_full", "mispredict", "rob_full", "rs_full", "lsq_full",
+    "fu_busy", "operand_wait", "cdb_conflict"
+};
+
+enum tom_dist {
+    dist_ifq, dist_rs_int, dist_rs_fp, dist_lsq, dist_rob,
+    dist_fu_int, dist_fu_fp, dist_cdb, dist_stall,
+    dist_NUM
+};
+
+//distributions over the cycles of the main run, registered by reg_tomasulo_stats
+static struct stat_stat_t* cycle_dist[dist_NUM];
+
+//the cycles of the main run so far with each value, added to the distributions when
+//the run ends rather than every cycle
+static unsigned int* cycle_count[dist_NUM];
+static int cycle_count_size[dist_NUM];
+
+//the mean of each occupancy distribution over all the cycles counted, and that mean as a
+//fraction of the structure's size; the print-out of a distribution only has the mean
+//number of cycles per value. cycle_sum is the value summed over the cycles
+static double cycle_mean[dist_NUM], cycle_util[dist_NUM];
+static counter_t cycle_sum[dist_NUM], cycle_total;
+
+//whether this run counts its cycles (sweep runs do not), and the stalls of the current cycle
+static __thread int sampling;
+static __thread unsigned int stalls;
 
 //the index of the last instruction fetched
-static int fetch_index = 0;
+static __thread int fetch_index = 0;
+
+//where instructions are fetched from: a whole captured trace, or the ring the functional
+//simulator is filling while the model runs
+static __thread instruction_trace_t* fetch_trace;
+static __thread instruction_ring_t* fetch_ring;
+
+//the cycle being simulated, and whether the end-of-cycle checks of the previous one are
+//still to run (a streaming run can stop between a cycle and its checks)
+static __thread int cycle;
+static __thread int cycle_ended;
 
 /* FUNCTIONAL UNITS */
-static int dont_fetch = 0;
+static __thread int dont_fetch = 0;
 
 /* RESERVATION STATIONS */
 
+#define RS_WORD_BITS 64
+
+static bool rs_alloc(reservation_stations_t* rs, int size) {
+
+    rs->size = size;
+    rs->count = 0;
+    rs->words = (size + RS_WORD_BITS - 1) / RS_WORD_BITS;
+    rs->entry = calloc(size, sizeof(instruction_t*));
+    rs->ready = calloc(rs->words, sizeof(unsigned long long));
+    return rs->entry && rs->ready;
+}
+
+static void rs_free(reservation_stations_t* rs) {
+
+    free(rs->entry);
+    free(rs->ready);
+}
+
+static void rs_set_ready(reservation_stations_t* rs, int p) {
+
+    rs->ready[p / RS_WORD_BITS] |= 1ULL << (p % RS_WORD_BITS);
+}
+
+static void rs_clear_ready(reservation_stations_t* rs, int p) {
+
+    rs->ready[p / RS_WORD_BITS] &= ~(1ULL << (p % RS_WORD_BITS));
+}
+
+//position of the oldest ready entry, -1 if none
+static int rs_oldest_ready(reservation_stations_t* rs) {
+
+    int w;
+    for (w = 0; w < rs->words; w++)
+        if (rs->ready[w])
+            return w * RS_WORD_BITS + __builtin_ctzll(rs->ready[w]);
+    return -1;
+}
+
+//puts instr behind the youngest entry
+static void rs_insert(reservation_stations_t* rs, instruction_t* instr) {
+
+    instr->rs_slot = rs->count;
+    rs->entry[rs->count++] = instr;
+}
+
+//frees the entry of instr, if it still has one, and moves the younger entries and their ready bits up
+static void rs_remove(reservation_stations_t* rs, instruction_t* instr) {
+
+    int p = instr->rs_slot;
+    int i, w, b;
+    unsigned long long word, low;
+
+    if (p < 0 || p >= rs->count || rs->entry[p] != instr)
+        return;
+    instr->rs_slot = -1;
+
+    for (i = p; i < rs->count - 1; i++) {
+        rs->entry[i] = rs->entry[i + 1];
+        rs->entry[i]->rs_slot = i;
+    }
+    rs->entry[--rs->count] = NULL;
+
+    w = p / RS_WORD_BITS;
+    b = p % RS_WORD_BITS;
+    word = rs->ready[w];
+    low = b ? (~0ULL >> (RS_WORD_BITS - b)) : 0;
+    rs->ready[w] = (word & low) | ((word >> 1) & ~low);
+    for (w = w + 1; w < rs->words; w++) {
+        rs->ready[w - 1] |= (rs->ready[w] & 1ULL) << (RS_WORD_BITS - 1);
+        rs->ready[w] >>= 1;
+    }
+}
+
+//the reservation stations an instruction waits in, NULL for branches, which need none
+static reservation_stations_t* rs_of(instruction_t* instr) {
+
+    if (LSQ_SIZE && (IS_LOAD(instr->op) || IS_STORE(instr->op)))
+        return &lsq;
+    if (USES_INT_FU(instr->op))
+        return &reservINT;
+    if (USES_FP_FU(instr->op))
+        return &reservFP;
+    return NULL;
+}
+
+/* DATA CACHE */
+
+//accesses the block holding addr, filling it into the least recently used way on a miss;
+//returns the cycles the access takes
+static int dl1_access(md_addr_t addr) {
+
+    int w, victim = 0;
+    md_addr_t block, *ways;
+    counter_t* used;
+
+    if (!DL1_SETS)
+        return FU_INT_LATENCY;
+
+    block = addr / DL1_BLOCK;
+    ways = &dl1_block[(block % DL1_SETS) * DL1_ASSOC];
+    used = &dl1_used[(block % DL1_SETS) * DL1_ASSOC];
+
+    stats.dl1_accesses++;
+    dl1_clock++;
+    for (w = 0; w < DL1_ASSOC; w++) {
+        if (used[w] && ways[w] == block) {
+            used[w] = dl1_clock;
+            return DL1_LATENCY;
+        }
+        if (used[w] < used[victim])
+            victim = w;
+    }
+
+    stats.dl1_misses++;
+    ways[victim] = block;
+    used[victim] = dl1_clock;
+    return DL1_LATENCY + MEM_LATENCY;
+}
+
+
+/* 
+ * Description: 
+ * 	Adds the state at the end of the cycle just simulated, and the stalls seen in
+ *      it, to the per-cycle distributions
+ * Inputs:
+ * 	None
+ * Returns:
+ * 	None
+ */
+static void sample_cycle(void) {
+
+    int i;
+    unsigned int s;
+
+    if (!sampling)
+        return;
+
+    cycle_count[dist_ifq][instr_queue_size]++;
+    cycle_count[dist_rs_int][reservINT.count]++;
+    cycle_count[dist_rs_fp][reservFP.count]++;
+    if (cycle_count[dist_lsq])
+        cycle_count[dist_lsq][lsq.count]++;
+    if (cycle_count[dist_rob])
+        cycle_count[dist_rob][rob_count]++;
+    cycle_count[dist_fu_int][fu_int_busy]++;
+    cycle_count[dist_fu_fp][fu_fp_busy]++;
+    cycle_count[dist_cdb][cdb_busy]++;
+
+    for (i = 0, s = stalls; s; i++, s >>= 1)
+        if (s & 1)
+            cycle_count[dist_stall][i]++;
+}
+
+//adds the cycles counted by the run that just ended to the distributions
+static void flush_cycle_counts(void) {
+
+    int d, i;
+
+    //every cycle has one IFQ occupancy
+    for (i = 0; i < cycle_count_size[dist_ifq]; i++)
+        cycle_total += cycle_count[dist_ifq][i];
+
+    for (d = 0; d < dist_NUM; d++) {
+        for (i = 0; i < cycle_count_size[d]; i++) {
+            if (cycle_count[d][i])
+                stat_add_samples(cycle_dist[d], i, cycle_count[d][i]);
+            cycle_sum[d] += (counter_t)i * cycle_count[d][i];
+            cycle_count[d][i] = 0;
+        }
+        if (d != dist_stall && cycle_count_size[d] && cycle_total) {
+            cycle_mean[d] = (double)cycle_sum[d] / cycle_total;
+            cycle_util[d] = cycle_mean[d] / (cycle_count_size[d] - 1);
+        }
+    }
+}
+
+static void reg_cycle_dist(struct stat_sdb_t* sdb, int dist, char* name, char* desc,
+                           int max, int pf, char** imap) {
+
+    cycle_dist[dist] = stat_reg_dist(sdb, name, desc,
+                                     /* initial value */0,
+                                     /* array size */max + 1,
+                                     /* bucket size */1,
+                                     /* print format */pf,
+                                     /* format */NULL,
+                                     /* index map */imap,
+                                     /* print fn */NULL);
+    cycle_count[dist] = calloc(max + 1, sizeof(unsigned int));
+    if (!cycle_count[dist])
+        fatal("out of virtual memory");
+    cycle_count_size[dist] = max + 1;
+
+    if (dist != dist_stall) {
+        char buf[128], desc_buf[128];
+
+        sprintf(buf, "%s_mean", name);
+        sprintf(desc_buf, "mean of %s", name);
+        stat_reg_double(sdb, buf, desc_buf, &cycle_mean[dist], 0.0, NULL);
+        sprintf(buf, "%s_util", name);
+        sprintf(desc_buf, "%s_mean out of %d", name, max);
+        stat_reg_double(sdb, buf, desc_buf, &cycle_util[dist], 0.0, NULL);
+    }
+}
+
+/* 
+ * Description: 
+ * 	Registers the per-cycle distributions of the main run (the one runTomasulo or
+ *      startTomasulo simulates, not the sweeps) for a machine with the given parameters
+ * Inputs:
+ * 	sdb: the stats database
+ *      machine: the parameters of the main run
+ * Returns:
+ * 	None
+ */
+void reg_tomasulo_stats(struct stat_sdb_t* sdb, tomasulo_config_t* machine) {
+
+    reg_cycle_dist(sdb, dist_ifq, "tom_ifq_occupancy",
+                   "IFQ entries in use at the end of each cycle",
+                   machine->instr_queue_size, (PF_COUNT|PF_PDF), NULL);
+    reg_cycle_dist(sdb, dist_rs_int, "tom_rs_int_occupancy",
+                   "INT reservation stations in use at the end of each cycle",
+                   machine->reserv_int_size, (PF_COUNT|PF_PDF), NULL);
+    reg_cycle_dist(sdb, dist_rs_fp, "tom_rs_fp_occupancy",
+                   "FP reservation stations in use at the end of each cycle",
+                   machine->reserv_fp_size, (PF_COUNT|PF_PDF), NULL);
+    if (machine->lsq_size)
+        reg_cycle_dist(sdb, dist_lsq, "tom_lsq_occupancy",
+                       "load/store queue entries in use at the end of each cycle",
+                       machine->lsq_size, (PF_COUNT|PF_PDF), NULL);
+    if (machine->rob_size)
+        reg_cycle_dist(sdb, dist_rob, "tom_rob_occupancy",
+                       "reorder buffer entries in use at the end of each cycle",
+                       machine->rob_size, (PF_COUNT|PF_PDF), NULL);
+    reg_cycle_dist(sdb, dist_fu_int, "tom_fu_int_busy",
+                   "INT functional units busy at the end of each cycle",
+                   machine->fu_int_size, (PF_COUNT|PF_PDF), NULL);
+    reg_cycle_dist(sdb, dist_fu_fp, "tom_fu_fp_busy",
+                   "FP functional units busy at the end of each cycle",
+                   machine->fu_fp_size, (PF_COUNT|PF_PDF), NULL);
+    reg_cycle_dist(sdb, dist_cdb, "tom_cdb_busy",
+                   "common data buses broadcasting in each cycle",
+                   machine->cdb_size, (PF_COUNT|PF_PDF), NULL);
+    reg_cycle_dist(sdb, dist_stall, "tom_stall_cycles",
+                   "cycles with each stall (a cycle can have several)",
+                   stall_NUM - 1, PF_COUNT, stall_str);
+}
+
+/* BRANCH PREDICTORS */
+
+#define BPRED_TABLE_SIZE  2048 //2-bit counters
+#define BPRED_BTB_SIZE    512  //direct-mapped branch target buffer entries
+#define BPRED_RAS_SIZE    8    //return address stack entries
+#define BPRED_GSHARE_BITS 11   //global history bits gshare hashes into the counter index
+
+//a table of 2-bit counters for the direction of conditional branches, indexed by the PC
+//(bimod) or by the PC xor the global history (gshare), a BTB for the targets of taken
+//control instructions and a return address stack
+typedef struct table_bpred
+{
+    unsigned char counter[BPRED_TABLE_SIZE];
+    md_addr_t btb_pc[BPRED_BTB_SIZE];
+    md_addr_t btb_target[BPRED_BTB_SIZE];
+    md_addr_t ras[BPRED_RAS_SIZE];
+    int ras_top;
+    int history_bits;
+    unsigned int history;
+}table_bpred_t;
+
+static void* bimod_create(void) {
+
+    return calloc(1, sizeof(table_bpred_t));
+}
+
+static void* gshare_create(void) {
+
+    table_bpred_t* bp = calloc(1, sizeof(table_bpred_t));
+    if (bp) bp->history_bits = BPRED_GSHARE_BITS;
+    return bp;
+}
+
+static int table_index(table_bpred_t* bp, md_addr_t pc) {
+
+    unsigned int history = bp->history & ((1U << bp->history_bits) - 1);
+    return ((pc / sizeof(md_inst_t)) ^ history) % BPRED_TABLE_SIZE;
+}
+
+static md_addr_t table_lookup(void* state, instruction_t* instr) {
+
+    table_bpred_t* bp = state;
+    md_inst_t inst = instr->inst;
+    md_addr_t fall_through = instr->pc + sizeof(md_inst_t);
+    int slot = (instr->pc / sizeof(md_inst_t)) % BPRED_BTB_SIZE;
+
+    if (MD_IS_RETURN(instr->op))
+        return bp->ras[bp->ras_top];
+    if (IS_COND_CTRL(instr->op) && bp->counter[table_index(bp, instr->pc)] < 2)
+        return fall_through;
+    return bp->btb_pc[slot] == instr->pc ? bp->btb_target[slot] : fall_through;
+}
+
+static void table_update(void* state, instruction_t* instr) {
+
+    table_bpred_t* bp = state;
+    md_inst_t inst = instr->inst;
+    int taken = instr->next_pc != instr->pc + sizeof(md_inst_t);
+    int slot = (instr->pc / sizeof(md_inst_t)) % BPRED_BTB_SIZE;
+
+    if (IS_COND_CTRL(instr->op)) {
+        unsigned char* counter = &bp->counter[table_index(bp, instr->pc)];
+        if (taken && *counter < 3) (*counter)++;
+        if (!taken && *counter > 0) (*counter)--;
+        bp->history = (bp->history << 1) | taken;
+    }
+
+    if (taken) {
+        bp->btb_pc[slot] = instr->pc;
+        bp->btb_target[slot] = instr->next_pc;
+    }
+
+    if (MD_IS_RETURN(instr->op)) {
+        bp->ras_top = (bp->ras_top + BPRED_RAS_SIZE - 1) % BPRED_RAS_SIZE;
+    }
+    else if (MD_IS_CALL(instr->op)) {
+        bp->ras_top = (bp->ras_top + 1) % BPRED_RAS_SIZE;
+        bp->ras[bp->ras_top] = instr->pc + sizeof(md_inst_t);
+    }
+}
+
+static md_addr_t nottaken_lookup(void* state, instruction_t* instr) {
+
+    return instr->pc + sizeof(md_inst_t);
+}
+
+tomasulo_bpred_t tomasulo_bpreds[] = {
+    { "perfect",  NULL,          NULL,            NULL,         NULL },
+    { "nottaken", NULL,          nottaken_lookup, NULL,         NULL },
+    { "bimod",    bimod_create,  table_lookup,    table_update, free },
+    { "gshare",   gshare_create, table_lookup,    table_update, free },
+    { NULL,       NULL,          NULL,            NULL,         NULL }
+};
+
+int find_tomasulo_bpred(char* name) {
+
+    int i;
+
+    for (i = 0; tomasulo_bpreds[i].name; i++)
+        if (!strcmp(tomasulo_bpreds[i].name, name))
+            return i;
+
+    fatal("tomasulo: unknown branch predictor `%s' (perfect, nottaken, bimod, gshare)", name);
+    return -1;
+}
+
+/* 
+ * Description: 
+ * 	Predicts the next PC of a control instruction being fetched, and blocks fetch
+ *      behind it when the prediction is wrong
+ * Inputs:
+ * 	instr: the control instruction
+ * Returns:
+ * 	None
+ */
+static void predict_branch(instruction_t* instr) {
+
+    tomasulo_bpred_t* bp = &tomasulo_bpreds[config.bpred];
+
+    stats.branches++;
+    if (!bp->lookup)
+        return;
+
+    if (bp->lookup(bpred_state, instr) != instr->next_pc) {
+        stats.mispredicts++;
+        fetch_blocked_by = instr;
+    }
+    if (bp->update)
+        bp->update(bpred_state, instr);
+}
+
 
 /* 
  * Description: 
@@ -124,14 +624,7 @@ static bool is_simulation_done(counter_t sim_insn) {
 
         /*  Loop through all the reservation stations, functional units and the CDB
             in order to verify that they are all empty */
-        for (i = 0; i < INSTR_QUEUE_SIZE; i++)
-            if (instr_queue[i]) return 0;
-
-        for (i = 0; i < RESERV_INT_SIZE; i++)
-            if (reservINT[i]) return 0;
-
-        for (i = 0; i < RESERV_FP_SIZE; i++)
-            if (reservFP[i]) return 0;
+        if (instr_queue_size || reservINT.count || reservFP.count || lsq.count || rob_count) return 0;
 
         for (i = 0; i < FU_INT_SIZE; i++)
             if (fuINT[i]) return 0;
@@ -139,7 +632,8 @@ static bool is_simulation_done(counter_t sim_insn) {
         for (i = 0; i < FU_FP_SIZE; i++)
             if (fuFP[i]) return 0;
 
-        if (commonDataBus) return 0;
+        for (i = 0; i < CDB_SIZE; i++)
+            if (commonDataBus[i]) return 0;
 
         return 1;
     }
@@ -147,6 +641,33 @@ static bool is_simulation_done(counter_t sim_insn) {
     return 0; //ECE552: you can change this as needed; we've added this so the code provided to you compiles
 }
 
+/* 
+ * Description: 
+ * 	Commits up to DISPATCH_WIDTH complete instructions from the head of the reorder
+ *      buffer, in program order, each in a cycle after it completed
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+void ROB_To_commit(int current_cycle) {
+
+    int n;
+
+    for (n = 0; n < DISPATCH_WIDTH && rob_count; n++) {
+        instruction_t * head = rob[rob_head];
+        if (!head->done_cycle || head->done_cycle >= current_cycle)
+            break;
+
+        head->tom_commit_cycle = current_cycle;
+        if (LSQ_SIZE && IS_STORE(head->op))
+            rs_remove(&lsq, head);
+        rob[rob_head] = NULL;
+        rob_head = (rob_head + 1) % ROB_SIZE;
+        rob_count--;
+    }
+}
+
 /* 
  * Description: 
  * 	Retires the instruction from writing to the Common Data Bus
@@ -158,45 +679,54 @@ static bool is_simulation_done(counter_t sim_insn) {
 void CDB_To_retire(int current_cycle) {
 
     /* ECE552: YOUR CODE GOES HERE */
-    int i, j;
-
-    /* Check if the CDB is occupied. */
-    if (commonDataBus != NULL) {
-
-        /*  Loop through all the INT and FP reservation stations and check if any instruction is waiting
-            for the instruction on the CDB to finish. If so, make that particular Q value NULL. */
-        for (i = 0; i < RESERV_INT_SIZE; i++) {
-            if (reservINT[i]) {
-                for (j = 0; j < 3; j++) {
-                    if (reservINT[i]->Q[j] == commonDataBus)
-                        reservINT[i]->Q[j] = NULL;
+    int i, j, bus;
+
+    /* Every occupied CDB broadcasts its instruction. */
+    for (bus = 0; bus < CDB_SIZE; bus++) {
+        instruction_t * done = commonDataBus[bus];
+        if (done == NULL) continue;
+
+        /*  Wake up the instructions waiting in the reservation stations for the one on the CDB:
+            make their Q values that point to it NULL. Each waiter is linked into the list through
+            the first of its Q slots that names the CDB instruction. */
+        instruction_t * waiter = done->waiters;
+        while (waiter) {
+            int link = -1;
+            for (j = 0; j < 3; j++) {
+                if (waiter->Q[j] == done) {
+                    if (link == -1) link = j;
+                    waiter->Q[j] = NULL;
                 }
             }
-        }
-        for (i = 0; i < RESERV_FP_SIZE; i++) {
-            if (reservFP[i]) {
-                for (j = 0; j < 3; j++) {
-                    if (reservFP[i]->Q[j] == commonDataBus)
-                        reservFP[i]->Q[j] = NULL;
-                }
+            instruction_t * next = waiter->next_waiter[link];
+            waiter->next_waiter[link] = NULL;
+            if (!waiter->Q[0] && !waiter->Q[1] && !waiter->Q[2]) {
+                if (rs_of(waiter))
+                    rs_set_ready(rs_of(waiter), waiter->rs_slot);
+                else
+                    waiter->done_cycle = current_cycle; //a branch resolves once its operands arrive
             }
+            waiter = next;
         }
+        done->waiters = NULL;
 
-        /*  Set the map table entry of the CDB instruction to NULL. */
-        for (i = 0; i < MD_TOTAL_REGS; i++) {
-            if (map_table[i] == commonDataBus) {
-                        map_table[i] = NULL;
-            }
+        /*  Set the map table entries of the CDB instruction to NULL. Only its output registers
+            can point to it, and only if no younger instruction has renamed them since. */
+        for (i = 0; i < 2; i++) {
+            if (done->r_out[i] != DNA && map_table[done->r_out[i]] == done)
+                map_table[done->r_out[i]] = NULL;
         }
+
+        commonDataBus[bus] = NULL;
+        cdb_busy--;
     }
-    
-    commonDataBus = NULL;
 }
 
 
 /* 
  * Description: 
- * 	Moves an instruction from the execution stage to common data bus (if possible)
+ * 	Moves instructions from the execution stage and the load/store queue to the common
+ *      data buses (if possible), the oldest finished instructions first
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
@@ -205,62 +735,134 @@ void CDB_To_retire(int current_cycle) {
 void execute_To_CDB(int current_cycle) {
 
     /* ECE552: YOUR CODE GOES HERE */
-    int i, j;
-    int index = -1;
-    int int_or_fp = -1;
-    int station = -1;
-
-    /*  Loop through all the INT and FP functional units and check if any instruction has finished.
-        If so, put the oldest one of them on the CDB. */
-    for (i = 0; i < FU_INT_SIZE; i++) {
-        if (!fuINT[i]) continue;
-        if (current_cycle >= (fuINT[i]->tom_execute_cycle + 4)) {
-            /*  Only put the instruction on the CDB if it writes to a register. */
-            if (!WRITES_CDB(fuINT[i]->op)) {
-                for (j = 0; j < RESERV_INT_SIZE; j++)
-                    if (reservINT[j] == fuINT[i]) reservINT[j] = NULL;
-                fuINT[i] = NULL;
-                continue;
+    int i, bus;
+
+    /*  Fill the CDBs one at a time with the oldest finished instruction left in the FUs. */
+    for (bus = 0; bus < CDB_SIZE; bus++) {
+        int index = -1;
+        int int_or_fp = -1;
+        int station = -1;
+
+        /*  Loop through all the INT and FP functional units and check if any instruction has finished.
+            If so, put the oldest one of them on the CDB. Without the issue fix an instruction can
+            sit in several FUs; once one of them has put it on a CDB this cycle, the others wait. */
+        for (i = 0; i < FU_INT_SIZE; i++) {
+            if (!fuINT[i] || fuINT[i]->tom_cdb_cycle == current_cycle) continue;
+            if (current_cycle >= (fuINT[i]->tom_execute_cycle + FU_INT_LATENCY)) {
+                /*  Only put the instruction on the CDB if it writes to a register. */
+                if (!WRITES_CDB(fuINT[i]->op)) {
+                    fuINT[i]->done_cycle = current_cycle;
+                    rs_remove(&reservINT, fuINT[i]);
+                    fuINT[i] = NULL;
+                    fu_int_busy--;
+                    continue;
+                }
+                if ((fuINT[i]->index < index) || (index == -1)) 
+                {
+                    index = fuINT[i]->index;
+                    int_or_fp = 0;
+                    station = i;
+                }
             }
-            if ((fuINT[i]->index < index) || (index == -1)) 
-            {
-                index = fuINT[i]->index;
-                int_or_fp = 0;
-                station = i;
+        }
+        for (i = 0; i < FU_FP_SIZE; i++) {
+            if (!fuFP[i] || fuFP[i]->tom_cdb_cycle == current_cycle) continue;
+            if (current_cycle >= (fuFP[i]->tom_execute_cycle + FU_FP_LATENCY)) {
+                if ((fuFP[i]->index < index) || (index == -1)) 
+                {
+                    index = fuFP[i]->index;
+                    int_or_fp = 1;
+                    station = i;
+                }
             }
         }
-    }
-    for (i = 0; i < FU_FP_SIZE; i++) {
-        if (!fuFP[i]) continue;
-        if (current_cycle >= (fuFP[i]->tom_execute_cycle + 9)) {
-            if ((fuFP[i]->index < index) || (index == -1)) 
-            {
-                index = fuFP[i]->index;
-                int_or_fp = 1;
-                station = i;
+        /*  The load/store queue is in age order, so its first finished load is its oldest. */
+        for (i = 0; i < lsq.count; i++) {
+            instruction_t * load = lsq.entry[i];
+            if (!IS_LOAD(load->op) || !load->tom_execute_cycle) continue;
+            if (current_cycle >= (load->tom_execute_cycle + load->mem_latency)) {
+                if ((load->index < index) || (index == -1))
+                {
+                    index = load->index;
+                    int_or_fp = 2;
+                    station = i;
+                }
+                break;
             }
         }
-    }
 
-    /*  Put the oldest instruction on the CDB, empty the corresponding functional unit
-        and reservation station, and set tom_cdb_cycle to the current cycle. */
-    if (index != -1)
-    {
+        /*  Nothing else has finished: leave the remaining CDBs idle. */
+        if (index == -1)
+            break;
+
+        /*  Put the oldest instruction on the CDB, empty the corresponding functional unit
+            and reservation station, and set tom_cdb_cycle to the current cycle. */
         if (int_or_fp == 1)
         {
             fuFP[station]->tom_cdb_cycle = current_cycle;
-            commonDataBus = fuFP[station];
+            fuFP[station]->done_cycle = current_cycle;
+            commonDataBus[bus] = fuFP[station];
             fuFP[station] = NULL;
-            for (i = 0; i < RESERV_FP_SIZE; i++)
-                if (reservFP[i] == commonDataBus) reservFP[i] = NULL;
+            fu_fp_busy--;
+            rs_remove(&reservFP, commonDataBus[bus]);
+        }
+        else if (int_or_fp == 2)
+        {
+            lsq.entry[station]->tom_cdb_cycle = current_cycle;
+            lsq.entry[station]->done_cycle = current_cycle;
+            commonDataBus[bus] = lsq.entry[station];
+            rs_remove(&lsq, commonDataBus[bus]);
         }
         else
         {
             fuINT[station]->tom_cdb_cycle = current_cycle;
-            commonDataBus = fuINT[station];
+            fuINT[station]->done_cycle = current_cycle;
+            commonDataBus[bus] = fuINT[station];
             fuINT[station] = NULL;
-            for (i = 0; i < RESERV_INT_SIZE; i++)
-                if (reservINT[i] == commonDataBus) reservINT[i] = NULL;
+            fu_int_busy--;
+            rs_remove(&reservINT, commonDataBus[bus]);
+        }
+        cdb_busy++;
+    }
+
+    /*  Every CDB is taken: see whether a finished instruction was left without one. */
+    if (sampling && bus == CDB_SIZE) {
+        for (i = 0; i < FU_INT_SIZE; i++)
+            if (fuINT[i] && fuINT[i]->tom_cdb_cycle != current_cycle &&
+                current_cycle >= fuINT[i]->tom_execute_cycle + FU_INT_LATENCY)
+                stalls |= 1U << stall_cdb_conflict;
+        for (i = 0; i < FU_FP_SIZE; i++)
+            if (fuFP[i] && fuFP[i]->tom_cdb_cycle != current_cycle &&
+                current_cycle >= fuFP[i]->tom_execute_cycle + FU_FP_LATENCY)
+                stalls |= 1U << stall_cdb_conflict;
+        for (i = 0; i < lsq.count; i++)
+            if (IS_LOAD(lsq.entry[i]->op) && lsq.entry[i]->tom_execute_cycle &&
+                current_cycle >= lsq.entry[i]->tom_execute_cycle + lsq.entry[i]->mem_latency)
+                stalls |= 1U << stall_cdb_conflict;
+    }
+}
+
+//notes why instructions of a class did not issue: ready ones left over mean its FUs are
+//all busy, a free FU with only waiting ones means the class is waiting for operands
+static void note_issue_stalls(reservation_stations_t* rs, int busy, int fus) {
+
+    int i;
+
+    if (!sampling)
+        return;
+
+    if (rs_oldest_ready(rs) != -1) {
+        stalls |= 1U << stall_fu_busy;
+        return;
+    }
+
+    if (busy == fus)
+        return;
+
+    for (i = 0; i < rs->count; i++) {
+        if (rs->entry[i]->Q[0] || rs->entry[i]->Q[1] || rs->entry[i]->Q[2]) {
+            stalls |= 1U << stall_operand_wait;
+            return;
         }
     }
 }
@@ -278,136 +880,222 @@ void execute_To_CDB(int current_cycle) {
 void issue_To_execute(int current_cycle) {
 
     /* ECE552: YOUR CODE GOES HERE */
-    int i, j;
+    int i, station;
 
-    /*  Loop through all the INT and FP functional units and check is any is available. If so, loop through the
-        reservation stations and check if any instruction's dependencies have been resolved. Put the the oldest
-        'ready' instruction on the FU. Can put multiple instructions on the FU if units are available. */
+    /*  Loop through all the INT and FP functional units and check is any is available. If so, put the oldest
+        'ready' instruction on the FU: the reservation stations are in age order, so it is the first set bit
+        of the ready mask. Can put multiple instructions on the FU if units are available.
+        An instruction keeps its RS entry while it executes, so its ready bit is cleared when it issues. */
     for (i = 0; i < FU_INT_SIZE; i++) {
         if (!fuINT[i]) {
-            int index = -1;
-            int station = -1;
-            for (j = 0; j < RESERV_INT_SIZE; j++) {
-                if (reservINT[j]) {
-                    if (!reservINT[j]->Q[0] && !reservINT[j]->Q[1] && !reservINT[j]->Q[2]) {
-                        if ((reservINT[j]->index < index) || (index == -1)) {
-                            index = reservINT[j]->index;
-                            station = j;
-                        }
-                    }
-                }
-            }
+            station = rs_oldest_ready(&reservINT);
+            if (station == -1) break;
+
             /*  Put the oldest instruction on the functional unit and set tom_execute_cycle to the current cycle. */
-            if (index != -1) {
-                fuINT[i] = reservINT[station];
-                fuINT[i]->tom_execute_cycle = current_cycle;
-	    }
+            fuINT[i] = reservINT.entry[station];
+            fu_int_busy++;
+            fuINT[i]->tom_execute_cycle = current_cycle;
+            if (ISSUE_FIX) rs_clear_ready(&reservINT, station);
         }
     }
 
     for (i = 0; i < FU_FP_SIZE; i++) {
         if (!fuFP[i]) {
-            int index = -1;
-            int station = -1;
-            for (j = 0; j < RESERV_FP_SIZE; j++) {
-                if (reservFP[j]) {
-                    if (!reservFP[j]->Q[0] && !reservFP[j]->Q[1] && !reservFP[j]->Q[2]) {
-                        if ((reservFP[j]->index < index) || (index == -1)) {
-                            index = reservFP[j]->index;
-                            station = j;
-                        }
-                    }
-                }
-            }
+            station = rs_oldest_ready(&reservFP);
+            if (station == -1) break;
+
             /*  Put the oldest instruction on the functional unit and set tom_execute_cycle to the current cycle. */
-            if (index != -1) {
-                fuFP[i] = reservFP[station];
-                fuFP[i]->tom_execute_cycle = current_cycle;
-            }
+            fuFP[i] = reservFP.entry[station];
+            fu_fp_busy++;
+            fuFP[i]->tom_execute_cycle = current_cycle;
+            if (ISSUE_FIX) rs_clear_ready(&reservFP, station);
         }
     }    
+
+    note_issue_stalls(&reservINT, fu_int_busy, FU_INT_SIZE);
+    note_issue_stalls(&reservFP, fu_fp_busy, FU_FP_SIZE);
 }
 
 /* 
  * Description: 
- * 	Moves instruction(s) from the dispatch stage to the issue stage
+ * 	Starts up to MEM_PORTS loads and stores from the load/store queue, oldest first.
+ *      A store executes once its address and data are ready, writing the cache. A load
+ *      waits for its address and for the address of every older store; it then takes
+ *      its value from the youngest older store to the same doubleword, once that
+ *      store's data is ready, or else from the cache.
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void dispatch_To_issue(int current_cycle) {
+void LSQ_To_memory(int current_cycle) {
+
+    int i, k;
+    int ports = MEM_PORTS;
+    bool unknown_store = 0;
+
+    for (i = 0; i < lsq.count && ports; i++) {
+        instruction_t * mem = lsq.entry[i];
+
+        /*  r_in[0] of a store is its data, r_in[1] and r_in[2] make up the address. */
+        if (IS_STORE(mem->op)) {
+            if (mem->Q[1] || mem->Q[2]) {
+                unknown_store = 1;
+                continue;
+            }
+            if (mem->tom_execute_cycle || mem->Q[0])
+                continue;
+
+            mem->tom_execute_cycle = current_cycle;
+            mem->done_cycle = current_cycle;
+            dl1_access(mem->mem_addr);
+            ports--;
+
+            /*  Without a reorder buffer nothing holds the store back: it has written memory. */
+            if (!ROB_SIZE) {
+                rs_remove(&lsq, mem);
+                i--;
+            }
+            continue;
+        }
+
+        if (mem->tom_execute_cycle || mem->Q[0] || mem->Q[1] || mem->Q[2] || unknown_store)
+            continue;
+
+        for (k = i - 1; k >= 0; k--)
+            if (IS_STORE(lsq.entry[k]->op) && (lsq.entry[k]->mem_addr >> 3) == (mem->mem_addr >> 3))
+                break;
+
+        if (k >= 0) {
+            if (lsq.entry[k]->Q[0])
+                continue;
+            mem->mem_latency = LSQ_FORWARD_LATENCY;
+            stats.forwarded++;
+        }
+        else
+            mem->mem_latency = dl1_access(mem->mem_addr);
+
+        mem->tom_execute_cycle = current_cycle;
+        stats.loads++;
+        ports--;
+    }
+}
+
+/* 
+ * Description: 
+ * 	Adds a newly dispatched instruction to the waiter list of every producer in its Q,
+ *      once per producer, so that the producer's broadcast can find it without a scan
+ * Inputs:
+ * 	instr: the instruction entering a reservation station
+ * Returns:
+ * 	None
+ */
+static void wait_for_producers(instruction_t* instr) {
+
+    int j;
+
+    for (j = 0; j < 3; j++) {
+        instr->next_waiter[j] = NULL;
+        if (!instr->Q[j]) continue;
+        if ((j > 0 && instr->Q[j] == instr->Q[0]) || (j > 1 && instr->Q[j] == instr->Q[1])) continue;
+        instr->next_waiter[j] = instr->Q[j]->waiters;
+        instr->Q[j]->waiters = instr;
+    }
+}
+
+/* 
+ * Description: 
+ * 	Moves the instruction at the head of the IFQ to the issue stage (if possible)
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	True: if the head left the IFQ
+ */
+static bool dispatch_head(int current_cycle) {
 
     /* ECE552: YOUR CODE GOES HERE */
     /* The basic premise of this fn is 
        'dispatch an instruction to the Reservation Station */
-    int i, j;
+    int j;
+    reservation_stations_t * rs;
     
     /* Check if the fetch queue is empty */
-    instruction_t * head = instr_queue[0];
-    if (!head) return;
-
-    /* If the instr needs an integer reservation station,
-       check through all integer RS and find an empty one */
-    if (USES_INT_FU(head->op)) {
-        for (i = 0; i < RESERV_INT_SIZE; i++)
-            if (!reservINT[i]) {
-                head->tom_issue_cycle = current_cycle;
-                reservINT[i] = head;
-                for (j = 0; j < 3; j++) {
-                    if (head->r_in[j] != DNA)
-                        head->Q[j] = map_table[head->r_in[j]];
-                    else
-                        head->Q[j] = NULL;
-                }
-                if (head->r_out[0] != DNA)
-                    map_table[head->r_out[0]] = head;
-                if (head->r_out[1] != DNA)
-                    map_table[head->r_out[1]] = head;
-                for (j = 0; j < INSTR_QUEUE_SIZE-1; j++)
-                    instr_queue[j] = instr_queue[j+1];
-                instr_queue[INSTR_QUEUE_SIZE-1] = NULL;
-                instr_queue_size--;
-                return;
-            }        
+    if (!instr_queue_size) return 0;
+    instruction_t * head = instr_queue[instr_queue_head];
+
+    /* With a reorder buffer every instruction needs an entry in it */
+    if (ROB_SIZE && rob_count == ROB_SIZE) {
+        stalls |= 1U << stall_rob_full;
+        return 0;
     }
-    
-    /* If the instr needs an FP reservation station,
-       check through all FP RS and find an empty one */
-    else if (USES_FP_FU(head->op)) {
-        for (i = 0; i < RESERV_FP_SIZE; i++) {
-            if (!reservFP[i]) {
-                head->tom_issue_cycle = current_cycle;
-                reservFP[i] = head;
-                for (j = 0; j < 3; j++) {
-                    if (head->r_in[j] != DNA)
-                        head->Q[j] = map_table[head->r_in[j]];
-                    else
-                        head->Q[j] = NULL;
-                }
-                if (head->r_out[0] != DNA)
-                    map_table[head->r_out[0]] = head;
-                if (head->r_out[1] != DNA)
-                    map_table[head->r_out[1]] = head;
-                for (j = 0; j < INSTR_QUEUE_SIZE-1; j++)
-                    instr_queue[j] = instr_queue[j+1];  
-                instr_queue[INSTR_QUEUE_SIZE-1] = NULL;
-                instr_queue_size--;  
-                return;
-            }
+
+    /* If the instr needs an integer or FP reservation station, or a
+       load/store queue entry, check that one of its class is free */
+    if ((rs = rs_of(head))) {
+        if (rs->count == rs->size) {
+            stalls |= 1U << (rs == &lsq ? stall_lsq_full : stall_rs_full);
+            return 0;
         }
-    }
 
-    /* Instr is neither an FP or an INT type (possibly
-       conditional/unconditional branches, so evict the instr
-       from the fetch queue */
+        head->tom_issue_cycle = current_cycle;
+        rs_insert(rs, head);
+        for (j = 0; j < 3; j++) {
+            if (head->r_in[j] != DNA)
+                head->Q[j] = map_table[head->r_in[j]];
+            else
+                head->Q[j] = NULL;
+        }
+        wait_for_producers(head);
+        if (!head->Q[0] && !head->Q[1] && !head->Q[2])
+            rs_set_ready(rs, head->rs_slot);
+        if (head->r_out[0] != DNA)
+            map_table[head->r_out[0]] = head;
+        if (head->r_out[1] != DNA)
+            map_table[head->r_out[1]] = head;
+    }
     else {
-        for (i = 0; i < INSTR_QUEUE_SIZE-1; i++)
-            instr_queue[i] = instr_queue[i+1];
-        instr_queue[INSTR_QUEUE_SIZE-1] = NULL;
-        instr_queue_size--;
-        return;
+        /* Instr is neither an FP or an INT type (possibly
+           conditional/unconditional branches): it needs no reservation
+           station, but resolves only once the registers it reads are ready,
+           in the next cycle at the earliest */
+        head->rs_slot = -1;
+        for (j = 0; j < 3; j++) {
+            if (head->r_in[j] != DNA)
+                head->Q[j] = map_table[head->r_in[j]];
+            else
+                head->Q[j] = NULL;
+        }
+        wait_for_producers(head);
+        if (!head->Q[0] && !head->Q[1] && !head->Q[2])
+            head->done_cycle = current_cycle + 1;
     }
+
+    if (ROB_SIZE)
+        rob[(rob_head + rob_count++) % ROB_SIZE] = head;
+
+    /* Evict the instr from the fetch queue */
+    instr_queue[instr_queue_head] = NULL;
+    instr_queue_head = (instr_queue_head + 1) % INSTR_QUEUE_SIZE;
+    instr_queue_size--;
+    return 1;
+}
+
+/* 
+ * Description: 
+ * 	Moves instruction(s) from the dispatch stage to the issue stage, in order and up to
+ *      DISPATCH_WIDTH per cycle, stopping at the first one that cannot get a reservation station
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+void dispatch_To_issue(int current_cycle) {
+
+    int n;
+
+    for (n = 0; n < DISPATCH_WIDTH; n++)
+        if (!dispatch_head(current_cycle))
+            break;
 }
 
 /* 
@@ -428,65 +1116,125 @@ void fetch(instruction_trace_t* trace) {
 
 /* 
  * Description: 
- * 	Calls fetch and dispatches an instruction at the same cycle (if possible)
+ * 	Calls fetch and dispatches up to DISPATCH_WIDTH instructions at the same cycle (if possible)
  * Inputs:
- *      trace: instruction trace with all the instructions executed
  * 	current_cycle: the cycle we are at
+ *      sim_insn: the number of instructions that may be fetched
  * Returns:
  * 	None
  */
-void fetch_To_dispatch(instruction_trace_t* trace, int current_cycle) {
+void fetch_To_dispatch(int current_cycle, counter_t sim_insn) {
 
-    fetch(trace);
+    fetch(fetch_trace);
     
     /* ECE552: YOUR CODE GOES HERE */
 
+    int n;
+
     /*  Check if the IFQ is full and if all the instructions have already been fetched. */
-    if ((instr_queue_size != INSTR_QUEUE_SIZE) && (!dont_fetch)) {
-        instruction_t * instr = get_instr(trace, fetch_index++);
+    for (n = 0; n < DISPATCH_WIDTH; n++) {
+        if (dont_fetch || (fetch_index >= sim_insn))
+            break;
+        if (instr_queue_size == INSTR_QUEUE_SIZE) {
+            stalls |= 1U << stall_ifq_full;
+            break;
+        }
+
+        /*  After a mispredicted branch, wait until it has resolved and the front end
+            has been redirected. */
+        if (fetch_blocked_by) {
+            if (!fetch_blocked_by->done_cycle ||
+                current_cycle < fetch_blocked_by->done_cycle + MISPREDICT_PENALTY) {
+                stalls |= 1U << stall_mispredict;
+                break;
+            }
+            fetch_blocked_by = NULL;
+        }
+
+        instruction_t * instr = fetch_ring ? ring_get_instr(fetch_ring, fetch_index++)
+                                           : get_instr(fetch_trace, fetch_index++);
         /*  If the instruction is not a TRAP instruction, then add it to the IFQ
             and set tom_dispatch_cycle to the current cycle. */
         if (!IS_TRAP(instr->op))
-            instr_queue[instr_queue_size++] = instr;
+            instr_queue[(instr_queue_head + instr_queue_size++) % INSTR_QUEUE_SIZE] = instr;
             instr->tom_dispatch_cycle = current_cycle;
+
+        if (IS_CTRL(instr->op))
+            predict_branch(instr);
     }
 }
 
+//the structures that learn from the instruction stream: the branch predictor and data cache
+static void alloc_warm_state(void)
+{
+    dl1_block = calloc(DL1_SETS * DL1_ASSOC + 1, sizeof(md_addr_t));
+    dl1_used = calloc(DL1_SETS * DL1_ASSOC + 1, sizeof(counter_t));
+    dl1_clock = 0;
+    if (!dl1_block || !dl1_used)
+        fatal("out of virtual memory");
+
+    bpred_state = NULL;
+    if (tomasulo_bpreds[config.bpred].create &&
+        !(bpred_state = tomasulo_bpreds[config.bpred].create()))
+        fatal("out of virtual memory");
+}
+
+static void free_warm_state(void)
+{
+    free(dl1_block);
+    free(dl1_used);
+    if (tomasulo_bpreds[config.bpred].destroy)
+        tomasulo_bpreds[config.bpred].destroy(bpred_state);
+}
+
 /* 
  * Description: 
- * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline
+ * 	Allocates and empties the pipeline of a new run
  * Inputs:
- *      trace: instruction trace with all the instructions executed
+ *      machine: the parameters of the machine to simulate
  * Returns:
- * 	The total number of cycles it takes to execute the instructions.
- * Extra Notes:
- * 	sim_num_insn: the number of instructions in the trace
+ * 	None
  */
-counter_t runTomasulo(instruction_trace_t* trace)
+static void start_run(tomasulo_config_t* machine)
 {
+    config = *machine;
+
     //initialize instruction queue
-    int i;
-    for (i = 0; i < INSTR_QUEUE_SIZE; i++) {
-        instr_queue[i] = NULL;
-    }
+    instr_queue = calloc(INSTR_QUEUE_SIZE, sizeof(instruction_t*));
+    instr_queue_head = 0;
+    instr_queue_size = 0;
+    fetch_index = 0;
+    dont_fetch = 0;
 
     //initialize reservation stations
-    for (i = 0; i < RESERV_INT_SIZE; i++) {
-        reservINT[i] = NULL;
-    }
+    if (!rs_alloc(&reservINT, RESERV_INT_SIZE) || !rs_alloc(&reservFP, RESERV_FP_SIZE))
+        fatal("out of virtual memory");
 
-    for(i = 0; i < RESERV_FP_SIZE; i++) {
-        reservFP[i] = NULL;
-    }
+    //initialize the load/store queue, which may have no entries
+    if (!rs_alloc(&lsq, LSQ_SIZE ? LSQ_SIZE : 1))
+        fatal("out of virtual memory");
 
     //initialize functional units
-    for (i = 0; i < FU_INT_SIZE; i++) {
-        fuINT[i] = NULL;
-    }
+    fuINT = calloc(FU_INT_SIZE, sizeof(instruction_t*));
+    fuFP = calloc(FU_FP_SIZE, sizeof(instruction_t*));
 
-    for (i = 0; i < FU_FP_SIZE; i++) {
-        fuFP[i] = NULL;
-    }
+    //initialize common data buses
+    commonDataBus = calloc(CDB_SIZE, sizeof(instruction_t*));
+    fu_int_busy = fu_fp_busy = cdb_busy = 0;
+
+    //initialize the reorder buffer, which may have no entries
+    rob = calloc(ROB_SIZE ? ROB_SIZE : 1, sizeof(instruction_t*));
+    rob_head = 0;
+    rob_count = 0;
+
+    if (!instr_queue || !fuINT || !fuFP || !commonDataBus || !rob)
+        fatal("out of virtual memory");
+
+    //initialize the branch predictor and the data cache, unless they are kept warm
+    if (!keep_warm)
+        alloc_warm_state();
+    fetch_blocked_by = NULL;
+    memset(&stats, 0, sizeof(stats));
 
     //initialize map_table to no producers
     int reg;
@@ -494,30 +1242,455 @@ counter_t runTomasulo(instruction_trace_t* trace)
         map_table[reg] = NULL;
     }
 
-    int cycle = 1;
+    cycle = 1;
+    cycle_ended = 0;
+}
+
+static void end_run(void)
+{
+    if (sampling)
+        flush_cycle_counts();
+    free(instr_queue);
+    rs_free(&reservINT);
+    rs_free(&reservFP);
+    rs_free(&lsq);
+    free(fuINT);
+    free(fuFP);
+    free(commonDataBus);
+    free(rob);
+    if (!keep_warm)
+        free_warm_state();
+}
+
+/* 
+ * Description: 
+ * 	Reports what the last run on this thread counted besides its cycles
+ * Inputs:
+ * 	stats: receives the counts
+ * Returns:
+ * 	None
+ */
+void tomasuloStats(tomasulo_stats_t* run_stats)
+{
+    *run_stats = stats;
+}
+
+/* 
+ * Description: 
+ * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline, until the last instruction
+ *      leaves it or, when more instructions are still to come, until a cycle might fetch one
+ *      that is not there yet. Such a cycle is only put off, so stopping and resuming does not
+ *      change any timestamp.
+ * Inputs:
+ *      sim_insn: the number of instructions that can be fetched (indices below it)
+ *      last: true if no instruction will be added after those
+ * Returns:
+ * 	True: if the simulation is finished
+ */
+static bool simulate(counter_t sim_insn, bool last)
+{
     while (true) {
 
+        /*  A cycle can fetch up to DISPATCH_WIDTH instructions. */
+        if (!last && (fetch_index + DISPATCH_WIDTH > sim_insn))
+            return 0;
+
+        if (cycle_ended) {
+            cycle_ended = 0;
+
+            /*  Before the last instruction is known fetch_index < sim_insn, so the
+                simulation cannot be done. */
+            if (last && is_simulation_done(sim_insn))
+                return 1;
+        }
+
         /* ECE552: YOUR CODE GOES HERE */
 
+        stalls = 0;
+
         /*  Run the stages in the reverse order in order to simulate the fact that
             they run in parallel. */
+        ROB_To_commit(cycle);
         CDB_To_retire(cycle);
         execute_To_CDB(cycle);
         issue_To_execute(cycle);
+        LSQ_To_memory(cycle);
 
         /* The reason we do fetch_to_dispatch before dispatch_to_issue
            is because in some cases (like the first valid instruction), we
            want to fetch and dispatch into an RS in the same cycle. We note a 1
            cycle improvement with this order */
-        fetch_To_dispatch(trace, cycle);
+        fetch_To_dispatch(cycle, sim_insn);
         dispatch_To_issue(cycle);
 
+        sample_cycle();
+
         /* Increment the cycle after all stages are run */
         cycle++;
+        cycle_ended = 1;
+    }
+}
+
+static counter_t run_trace(instruction_trace_t* trace, tomasulo_config_t* machine, int sampled)
+{
+    start_run(machine);
+    sampling = sampled && cycle_dist[dist_ifq];
+    fetch_trace = trace;
+    fetch_ring = NULL;
+
+    simulate(sim_num_insn, 1);
 
-        if (is_simulation_done(sim_num_insn))
+    end_run();
+    return cycle;
+}
+
+/* 
+ * Description: 
+ * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline, adding to the
+ *      per-cycle distributions if they are registered
+ * Inputs:
+ *      trace: instruction trace with all the instructions executed
+ *      machine: the parameters of the machine to simulate
+ * Returns:
+ * 	The total number of cycles it takes to execute the instructions.
+ * Extra Notes:
+ * 	sim_num_insn: the number of instructions in the trace
+ */
+counter_t runTomasulo(instruction_trace_t* trace, tomasulo_config_t* machine)
+{
+    return run_trace(trace, machine, 1);
+}
+
+/* 
+ * Description: 
+ * 	Starts a simulation that fetches from a ring the functional simulator keeps
+ *      filling, see advanceTomasulo and finishTomasulo
+ * Inputs:
+ *      ring: the ring instructions are put in
+ *      machine: the parameters of the machine to simulate
+ * Returns:
+ * 	None
+ */
+void startTomasulo(instruction_ring_t* ring, tomasulo_config_t* machine)
+{
+    start_run(machine);
+    sampling = cycle_dist[dist_ifq] != NULL;
+    fetch_trace = NULL;
+    fetch_ring = ring;
+}
+
+/* 
+ * Description: 
+ * 	Simulates as far as the instructions in the ring allow
+ * Inputs:
+ *      sim_insn: the number of instructions executed so far
+ * Returns:
+ * 	The oldest instruction the pipeline still needs; the ring can drop the ones before it
+ */
+int advanceTomasulo(counter_t sim_insn)
+{
+    int i, oldest;
+
+    simulate(sim_insn, 0);
+    oldest = fetch_index;
+
+    /*  Map table entries, Q values and waiter lists only point to instructions
+        that are in a reservation station, an FU or on a CDB, or to branches younger
+        than those. */
+    if (fetch_blocked_by && fetch_blocked_by->index < oldest)
+        oldest = fetch_blocked_by->index;
+    if (rob_count && rob[rob_head]->index < oldest)
+        oldest = rob[rob_head]->index;
+    if (instr_queue_size && instr_queue[instr_queue_head]->index < oldest)
+        oldest = instr_queue[instr_queue_head]->index;
+    if (reservINT.count && reservINT.entry[0]->index < oldest)
+        oldest = reservINT.entry[0]->index;
+    if (reservFP.count && reservFP.entry[0]->index < oldest)
+        oldest = reservFP.entry[0]->index;
+    if (lsq.count && lsq.entry[0]->index < oldest)
+        oldest = lsq.entry[0]->index;
+    for (i = 0; i < FU_INT_SIZE; i++)
+        if (fuINT[i] && fuINT[i]->index < oldest) oldest = fuINT[i]->index;
+    for (i = 0; i < FU_FP_SIZE; i++)
+        if (fuFP[i] && fuFP[i]->index < oldest) oldest = fuFP[i]->index;
+    for (i = 0; i < CDB_SIZE; i++)
+        if (commonDataBus[i] && commonDataBus[i]->index < oldest) oldest = commonDataBus[i]->index;
+
+    return oldest;
+}
+
+/* 
+ * Description: 
+ * 	Completes a simulation started with startTomasulo once every instruction is in the ring
+ * Inputs:
+ *      sim_insn: the total number of instructions executed
+ * Returns:
+ * 	The total number of cycles it takes to execute the instructions.
+ */
+counter_t finishTomasulo(counter_t sim_insn)
+{
+    simulate(sim_insn, 1);
+
+    end_run();
+    return cycle;
+}
+
+/* 
+ * Description: 
+ * 	Starts keeping the branch predictor and data cache of the machine from one
+ *      startTomasulo run to the next, for sampled simulation
+ * Inputs:
+ *      machine: the parameters every run until stopTomasuloWarming uses
+ * Returns:
+ * 	None
+ */
+void startTomasuloWarming(tomasulo_config_t* machine)
+{
+    config = *machine;
+    alloc_warm_state();
+    keep_warm = 1;
+}
+
+/* 
+ * Description: 
+ * 	Trains the kept branch predictor and data cache with an instruction executed
+ *      outside any run, as fetch and the load/store queue would; takes no time
+ * Inputs:
+ *      instr: the instruction, with its next_pc and mem_addr
+ * Returns:
+ * 	None
+ */
+void warmTomasulo(instruction_t* instr)
+{
+    tomasulo_bpred_t* bp = &tomasulo_bpreds[config.bpred];
+
+    if (IS_CTRL(instr->op) && bp->update)
+        bp->update(bpred_state, instr);
+
+    /*  Without a load/store queue memory never goes through the cache. The accesses
+        are counted in stats, which the next run clears. */
+    if (LSQ_SIZE && (MD_OP_FLAGS(instr->op) & F_MEM))
+        dl1_access(instr->mem_addr);
+}
+
+/* 
+ * Description: 
+ * 	Frees the kept branch predictor and data cache; later runs start them cold
+ * Inputs:
+ * 	None
+ * Returns:
+ * 	None
+ */
+void stopTomasuloWarming(void)
+{
+    keep_warm = 0;
+    free_warm_state();
+}
+
+/* 
+ * Description: 
+ * 	Dies on machine parameters the model cannot run with: every structure
+ *      needs at least one entry and every functional unit at least one cycle
+ * Inputs:
+ * 	machine: the parameters to check
+ * Returns:
+ * 	None
+ */
+void check_tomasulo_config(tomasulo_config_t* machine) {
+
+    if (machine->instr_queue_size < 1)
+        fatal("tomasulo: the instruction queue needs at least one entry");
+    if (machine->reserv_int_size < 1 || machine->reserv_fp_size < 1)
+        fatal("tomasulo: every reservation station class needs at least one entry");
+    if (machine->fu_int_size < 1 || machine->fu_fp_size < 1)
+        fatal("tomasulo: every functional unit class needs at least one unit");
+    if (machine->fu_int_latency < 1 || machine->fu_fp_latency < 1)
+        fatal("tomasulo: functional unit latencies must be at least one cycle");
+    if (machine->cdb_size < 1)
+        fatal("tomasulo: the machine needs at least one common data bus");
+    if (machine->dispatch_width < 1)
+        fatal("tomasulo: the dispatch width must be at least one instruction");
+    if (machine->rob_size < 0)
+        fatal("tomasulo: the reorder buffer cannot have a negative size");
+    if (machine->mispredict_penalty < 0)
+        fatal("tomasulo: the mispredict penalty cannot be negative");
+    if (machine->lsq_size < 0)
+        fatal("tomasulo: the load/store queue cannot have a negative size");
+    if (machine->mem_ports < 1)
+        fatal("tomasulo: the load/store queue needs at least one memory port");
+    if (machine->dl1_sets < 0 || machine->dl1_assoc < 1 || machine->dl1_block < 1)
+        fatal("tomasulo: the data cache needs sets >= 0, ways >= 1 and blocks of >= 1 byte");
+    if (machine->dl1_latency < 1 || machine->mem_latency < 0)
+        fatal("tomasulo: data cache hits take at least one cycle and misses cannot be faster");
+    if (machine->dl1_sets && !machine->lsq_size)
+        fatal("tomasulo: the data cache is accessed from the load/store queue, which has no entries");
+    if (machine->bpred < 0 || machine->bpred >= (int)(sizeof(tomasulo_bpreds) / sizeof(tomasulo_bpreds[0])) - 1)
+        fatal("tomasulo: no such branch predictor");
+}
+
+/* 
+ * Description: 
+ * 	Applies a "key=value,key=value" spec on top of the parameters in machine.
+ *      The keys are the names of the -tom: options, e.g. "rs:int=8,fu:int=4";
+ *      bpred takes a predictor name and issuefix true or false.
+ * Inputs:
+ * 	machine: the parameters to change
+ *      spec: the configuration, as given to -tom:sweep
+ * Returns:
+ * 	None
+ */
+void parse_tomasulo_config(tomasulo_config_t* machine, char* spec) {
+
+    char buf[256];
+    char *field, *save;
+
+    if (strlen(spec) >= sizeof(buf))
+        fatal("tomasulo: configuration `%s' is too long", spec);
+    strcpy(buf, spec);
+
+    for (field = strtok_r(buf, ",", &save); field; field = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(field, '=');
+        char *end;
+        int *param;
+        long v;
+
+        if (!value)
+            fatal("tomasulo: expected key=value in `%s', got `%s'", spec, field);
+        *value++ = '\0';
+
+        if (!strcmp(field, "bpred")) {
+            machine->bpred = find_tomasulo_bpred(value);
+            continue;
+        }
+        if (!strcmp(field, "issuefix")) {
+            if (!strcmp(value, "true"))
+                machine->issue_fix = TRUE;
+            else if (!strcmp(value, "false"))
+                machine->issue_fix = FALSE;
+            else
+                fatal("tomasulo: issuefix takes true or false, got `%s' in `%s'", value, spec);
+            continue;
+        }
+
+        if (!strcmp(field, "ifq"))          param = &machine->instr_queue_size;
+        else if (!strcmp(field, "rs:int"))  param = &machine->reserv_int_size;
+        else if (!strcmp(field, "rs:fp"))   param = &machine->reserv_fp_size;
+        else if (!strcmp(field, "fu:int"))  param = &machine->fu_int_size;
+        else if (!strcmp(field, "fu:fp"))   param = &machine->fu_fp_size;
+        else if (!strcmp(field, "lat:int")) param = &machine->fu_int_latency;
+        else if (!strcmp(field, "lat:fp"))  param = &machine->fu_fp_latency;
+        else if (!strcmp(field, "cdb"))     param = &machine->cdb_size;
+        else if (!strcmp(field, "width"))   param = &machine->dispatch_width;
+        else if (!strcmp(field, "rob"))     param = &machine->rob_size;
+        else if (!strcmp(field, "mplat"))   param = &machine->mispredict_penalty;
+        else if (!strcmp(field, "lsq"))     param = &machine->lsq_size;
+        else if (!strcmp(field, "mem:ports")) param = &machine->mem_ports;
+        else if (!strcmp(field, "dl1:sets"))  param = &machine->dl1_sets;
+        else if (!strcmp(field, "dl1:assoc")) param = &machine->dl1_assoc;
+        else if (!strcmp(field, "dl1:block")) param = &machine->dl1_block;
+        else if (!strcmp(field, "lat:dl1"))   param = &machine->dl1_latency;
+        else if (!strcmp(field, "lat:mem"))   param = &machine->mem_latency;
+        else
+            fatal("tomasulo: unknown parameter `%s' in `%s' (ifq, rs:int, rs:fp, fu:int, "
+                  "fu:fp, lat:int, lat:fp, cdb, width, rob, bpred, mplat, lsq, mem:ports, "
+                  "dl1:sets, dl1:assoc, dl1:block, lat:dl1, lat:mem, issuefix)", field, spec);
+
+        v = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0')
+            fatal("tomasulo: `%s' is not a number in `%s'", value, spec);
+        *param = (int)v;
+    }
+
+    check_tomasulo_config(machine);
+}
+
+/* SWEEPS */
+
+//configurations of a sweep, handed out to the worker threads one at a time
+typedef struct tomasulo_sweep
+{
+    instruction_trace_t* trace;
+    tomasulo_config_t* configs;
+    counter_t* cycles;
+    int num_configs;
+    int next_config;
+    pthread_mutex_t lock;
+}tomasulo_sweep_t;
+
+static void* sweep_worker(void* arg) {
+
+    tomasulo_sweep_t* sweep = arg;
+    //runTomasulo writes Q and the timestamps into the trace, so every
+    //thread replays its own copy
+    instruction_trace_t* trace = NULL;
+
+    while (true) {
+        int i;
+
+        pthread_mutex_lock(&sweep->lock);
+        i = sweep->next_config++;
+        pthread_mutex_unlock(&sweep->lock);
+        if (i >= sweep->num_configs)
             break;
+
+        if (trace)
+            reset_instr_trace(trace);
+        else
+            trace = copy_instr_trace(sweep->trace);
+
+        sweep->cycles[i] = run_trace(trace, &sweep->configs[i], 0);
     }
-  
-    return cycle;
+
+    free_instr_trace(trace);
+    return NULL;
+}
+
+/* 
+ * Description: 
+ * 	Simulates one functional trace on many machine configurations. The
+ *      configurations are spread over num_threads threads (one per online
+ *      processor when 0), each replaying a private copy of the trace, so the
+ *      memory used is num_threads times the trace.
+ * Inputs:
+ *      trace: instruction trace with all the instructions executed
+ *      configs: the machines to simulate
+ *      num_configs: the number of machines
+ *      num_threads: the number of threads to use, 0 for one per processor
+ *      cycles: receives the cycles taken on each machine
+ * Returns:
+ * 	None
+ */
+void sweepTomasulo(instruction_trace_t* trace, tomasulo_config_t* configs,
+                   int num_configs, int num_threads, counter_t* cycles) {
+
+    tomasulo_sweep_t sweep;
+    pthread_t* threads;
+    int i;
+
+    if (num_threads <= 0)
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > num_configs)
+        num_threads = num_configs;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    sweep.trace = trace;
+    sweep.configs = configs;
+    sweep.cycles = cycles;
+    sweep.num_configs = num_configs;
+    sweep.next_config = 0;
+    pthread_mutex_init(&sweep.lock, NULL);
+
+    threads = calloc(num_threads, sizeof(pthread_t));
+    if (!threads)
+        fatal("out of virtual memory");
+
+    for (i = 0; i < num_threads; i++)
+        if (pthread_create(&threads[i], NULL, sweep_worker, &sweep))
+            fatal("tomasulo: cannot start sweep thread %d", i);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&sweep.lock);
 }
@@ -0,0 +1,100 @@
+#ifndef TOMASULO_H
+#define TOMASULO_H
+
+#include "host.h"
+#include "instr.h"
+
+//machine parameters of the Tomasulo model
+typedef struct tomasulo_config
+{
+  int instr_queue_size; //instruction fetch queue entries
+  int reserv_int_size;  //INT reservation stations
+  int reserv_fp_size;   //FP reservation stations
+  int fu_int_size;      //INT functional units
+  int fu_fp_size;       //FP functional units
+  int fu_int_latency;   //cycles in an INT functional unit
+  int fu_fp_latency;    //cycles in an FP functional unit
+  int cdb_size;         //common data buses, one broadcast each per cycle
+  int dispatch_width;   //instructions fetched, dispatched and committed per cycle
+  int rob_size;         //reorder buffer entries, 0 for none (instructions leave at writeback)
+  int bpred;            //branch predictor, an index into tomasulo_bpreds
+  int mispredict_penalty; //cycles from a mispredicted branch resolving to fetching again
+  int lsq_size;         //load/store queue entries, 0 for none (loads and stores use the INT RS and FUs)
+  int mem_ports;        //loads and stores the load/store queue starts per cycle
+  int dl1_sets;         //data cache sets, 0 for no cache (every access takes fu_int_latency)
+  int dl1_assoc;        //data cache ways
+  int dl1_block;        //data cache block bytes
+  int dl1_latency;      //cycles of a data cache hit
+  int mem_latency;      //further cycles of a data cache miss
+  int issue_fix;        //issue an executing instruction only once; if 0 it issues again to
+                        //every other free FU, as the original submission does
+}tomasulo_config_t;
+
+//a branch predictor for the Tomasulo front end. Fetch asks lookup for the next PC of every
+//control instruction and stops after one whose prediction is not instr->next_pc until it
+//resolves; update then trains the predictor with the outcome. The trace holds no wrong path
+//to fetch, so update runs straight after lookup, in program order.
+typedef struct tomasulo_bpred
+{
+  char* name;
+  void* (*create)(void);
+  md_addr_t (*lookup)(void* state, instruction_t* instr);
+  void (*update)(void* state, instruction_t* instr);
+  void (*destroy)(void* state);
+}tomasulo_bpred_t;
+
+//the predictors, by name; entry 0, "perfect", has no functions and is never wrong
+extern tomasulo_bpred_t tomasulo_bpreds[];
+
+//index of the predictor called name in tomasulo_bpreds; dies if there is none
+extern int find_tomasulo_bpred(char* name);
+
+//what the last run on the calling thread counted besides its cycles
+typedef struct tomasulo_stats
+{
+  counter_t branches;    //control instructions fetched
+  counter_t mispredicts; //of which the predictor got the next PC wrong
+  counter_t loads;       //loads issued from the load/store queue
+  counter_t forwarded;   //of which took their value from an older store
+  counter_t dl1_accesses; //loads and stores that went to the data cache
+  counter_t dl1_misses;
+}tomasulo_stats_t;
+
+extern void tomasuloStats(tomasulo_stats_t* stats);
+
+//registers distributions over the cycles of the main run (occupancy of the IFQ,
+//reservation stations, LSQ and ROB, busy FUs and CDBs, and stall causes), sized
+//for the machine it simulates
+struct stat_sdb_t;
+extern void reg_tomasulo_stats(struct stat_sdb_t* sdb, tomasulo_config_t* machine);
+
+//dies on parameters the model cannot run with
+extern void check_tomasulo_config(tomasulo_config_t* machine);
+
+//applies a "key=value,key=value" spec (keys as in the -tom: options, e.g.
+//"rs:int=8,fu:int=4") on top of the parameters already in machine
+extern void parse_tomasulo_config(tomasulo_config_t* machine, char* spec);
+
+//simulates the trace on one machine, returns the number of cycles taken
+extern counter_t runTomasulo(instruction_trace_t* trace, tomasulo_config_t* machine);
+
+//streaming: starts a simulation fetching from the ring the functional simulator fills,
+//advances it as far as the ring allows and returns the oldest instruction it still
+//needs, and finishes it once the last instruction is in the ring, returning the cycles
+extern void startTomasulo(instruction_ring_t* ring, tomasulo_config_t* machine);
+extern int advanceTomasulo(counter_t sim_insn);
+extern counter_t finishTomasulo(counter_t sim_insn);
+
+//sampled simulation: keeps the branch predictor and data cache of the machine from one
+//streaming run to the next instead of starting them cold, and trains them with
+//warmTomasulo on the instructions fast-forwarded in between
+extern void startTomasuloWarming(tomasulo_config_t* machine);
+extern void warmTomasulo(instruction_t* instr);
+extern void stopTomasuloWarming(void);
+
+//simulates the trace on every configuration, num_threads at a time, each
+//thread on its own copy of the trace; cycles[i] is the result of configs[i]
+extern void sweepTomasulo(instruction_trace_t* trace, tomasulo_config_t* configs,
+                          int num_configs, int num_threads, counter_t* cycles);
+
+#endif
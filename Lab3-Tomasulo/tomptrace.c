@@ -0,0 +1,192 @@
+/* tomptrace.c - converts a Tomasulo pipeline trace for pipeview.pl
+ *
+ * Reads the binary trace sim-safe writes with -tom:pipetrace and prints it
+ * in the text format of ptrace.c, which pipeview.pl displays. An
+ * instruction enters IF when it is dispatched to the IFQ, DA when it is
+ * issued to a reservation station, EX when it starts executing, WB when it
+ * broadcasts on a CDB and CT when it commits from the reorder buffer, and
+ * leaves the cycle after its last stage or completion. The trace is in
+ * program order, so the stage changes of the instructions in flight are
+ * merged in cycle order through a heap that holds only those.
+ *
+ * usage: tomptrace <pipetrace> [<ptrace>]
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "ptrace.h"
+#include "instr.h"
+
+/* what happens to an instruction in a cycle; in the order they are printed
+   within a cycle */
+enum event_kind { EV_NEW, EV_ISSUE, EV_EXECUTE, EV_CDB, EV_COMMIT, EV_END };
+
+static char *event_stage[] = {
+  PST_IFETCH, PST_DISPATCH, PST_EXECUTE, PST_WRITEBACK, PST_COMMIT, NULL
+};
+
+struct event_t {
+  int cycle;
+  int iseq;
+  enum event_kind kind;
+  md_addr_t pc;
+  md_addr_t addr;
+  md_inst_t inst;
+};
+
+/* min-heap of the pending events, by cycle, then instruction, then kind */
+static struct event_t *heap = NULL;
+static int heap_size = 0, heap_max = 0;
+
+static int
+event_before(struct event_t *a, struct event_t *b)
+{
+  if (a->cycle != b->cycle)
+    return a->cycle < b->cycle;
+  if (a->iseq != b->iseq)
+    return a->iseq < b->iseq;
+  return a->kind < b->kind;
+}
+
+static void
+push_event(struct event_t *ev)
+{
+  int i;
+  struct event_t tmp;
+
+  if (heap_size == heap_max)
+    {
+      heap_max = heap_max ? 2 * heap_max : 1024;
+      heap = realloc(heap, heap_max * sizeof(struct event_t));
+      assert(heap != NULL);
+    }
+
+  i = heap_size++;
+  heap[i] = *ev;
+  while (i > 0 && event_before(&heap[i], &heap[(i - 1) / 2]))
+    {
+      tmp = heap[i];
+      heap[i] = heap[(i - 1) / 2];
+      heap[(i - 1) / 2] = tmp;
+      i = (i - 1) / 2;
+    }
+}
+
+static struct event_t
+pop_event(void)
+{
+  int i = 0, child;
+  struct event_t top = heap[0], tmp;
+
+  heap[0] = heap[--heap_size];
+  while ((child = 2 * i + 1) < heap_size)
+    {
+      if (child + 1 < heap_size && event_before(&heap[child + 1], &heap[child]))
+	child++;
+      if (!event_before(&heap[child], &heap[i]))
+	break;
+      tmp = heap[i];
+      heap[i] = heap[child];
+      heap[child] = tmp;
+      i = child;
+    }
+  return top;
+}
+
+/* prints the pending events before the given cycle */
+static void
+print_events(FILE *out, int before, int *last_cycle)
+{
+  struct event_t ev;
+
+  while (heap_size && heap[0].cycle < before)
+    {
+      ev = pop_event();
+      if (ev.cycle != *last_cycle)
+	{
+	  fprintf(out, "@ %d\n", ev.cycle);
+	  *last_cycle = ev.cycle;
+	}
+
+      if (ev.kind == EV_NEW)
+	{
+	  fprintf(out, "+ %d 0x%08x 0x%08x ", ev.iseq, ev.pc, ev.addr);
+	  md_print_insn(ev.inst, ev.pc, out);
+	  fprintf(out, "\n");
+	}
+      if (ev.kind == EV_END)
+	fprintf(out, "- %d\n", ev.iseq);
+      else
+	fprintf(out, "* %d %s 0x%08x\n", ev.iseq, event_stage[ev.kind], 0);
+    }
+}
+
+static void
+add_event(struct event_t *ev, enum event_kind kind, int cycle, int *last)
+{
+  if (!cycle)
+    return;
+  ev->kind = kind;
+  ev->cycle = cycle;
+  push_event(ev);
+  if (cycle > *last)
+    *last = cycle;
+}
+
+int
+main(int argc, char **argv)
+{
+  int last, last_cycle = -1, count = 0;
+  FILE *out = stdout;
+  pipetrace_t *pt;
+  instruction_t instr;
+  struct event_t ev;
+
+  if (argc < 2 || argc > 3)
+    {
+      fprintf(stderr, "usage: %s <pipetrace> [<ptrace>]\n", argv[0]);
+      exit(1);
+    }
+
+  pt = pipetrace_open(argv[1], "r");
+  if (argc == 3 && !(out = fopen(argv[2], "w")))
+    fatal("cannot open `%s'", argv[2]);
+
+  while (pipetrace_read(pt, &instr))
+    {
+      /* the last instruction is never fetched */
+      if (!instr.tom_dispatch_cycle)
+	continue;
+
+      /* no later instruction has an event before this one is dispatched */
+      print_events(out, instr.tom_dispatch_cycle, &last_cycle);
+
+      ev.iseq = instr.index;
+      ev.pc = instr.pc;
+      ev.addr = instr.mem_addr;
+      ev.inst = instr.inst;
+      last = 0;
+      add_event(&ev, EV_NEW, instr.tom_dispatch_cycle, &last);
+      add_event(&ev, EV_ISSUE, instr.tom_issue_cycle, &last);
+      add_event(&ev, EV_EXECUTE, instr.tom_execute_cycle, &last);
+      add_event(&ev, EV_CDB, instr.tom_cdb_cycle, &last);
+      add_event(&ev, EV_COMMIT, instr.tom_commit_cycle, &last);
+      if (instr.done_cycle > last)
+	last = instr.done_cycle;
+      add_event(&ev, EV_END, last + 1, &last);
+      count++;
+    }
+  print_events(out, INT_MAX, &last_cycle);
+
+  pipetrace_close(pt);
+  if (out != stdout && fclose(out))
+    fatal("could not write `%s'", argv[2]);
+  fprintf(stderr, "tomptrace: %d instructions\n", count);
+  return 0;
+}